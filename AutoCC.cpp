@@ -12,40 +12,34 @@
 
 #include <WiFi.h>
 #include "AutoCC.h"
+#include "AutoCCCodec.h"
+#include "AutoCCLink.h"
 
 unsigned long uniqueIdCounter = 0;
 
 void print(const char* message) {
-  if (DEBUGGING) Serial.println(message);
+  if (DEBUGGING) logLine(LOG_DEBUG, message);
 }
 
 void print(int number) {
-  if (DEBUGGING) Serial.println(number);
+  if (DEBUGGING) logLine(LOG_DEBUG, (long)number);
 }
 
 void print(const char* message, int number) {
-  if (DEBUGGING) {
-    Serial.print(message);
-    Serial.println(number);
-  }
+  if (DEBUGGING) logLine(LOG_DEBUG, message, (long)number);
 }
 
 void print(int number, const char* message) {
-    Serial.print(number);
-    Serial.println(message);
+  if (DEBUGGING) logLine(LOG_DEBUG, (long)number, message);
 }
 
 void print(const char* message, const char* message2) {
-  if (DEBUGGING) {
-    Serial.print(message);
-    Serial.println(message2);
-  }
+  if (DEBUGGING) logLine(LOG_DEBUG, message, message2);
 }
 
 // connect and verify wifi
 void connectToWifi(const int deviceType) {
   if (deviceType == DEVICE_SERVER) {
-    delay(SERVER_STARTUP_DELAY);
     WiFi.mode(WIFI_AP_STA);
   } else {
     WiFi.mode(WIFI_STA);
@@ -55,19 +49,20 @@ void connectToWifi(const int deviceType) {
 
 bool initESPNOW() {
   if (esp_now_init() != ESP_OK) {
-    print("Error initializing ESP-NOW");
+    logError("Error initializing ESP-NOW");
     return false;
   }
-  print("ESP NOW initialised");
+  logInfo("ESP NOW initialised");
   return true;
 }
 
-unsigned long generateUniqueId() {
+// count > 1 reserves a block of consecutive ids starting at the returned one
+unsigned long generateUniqueId(int count) {
   static unsigned long uniqueIdCounter = 0; 
   unsigned long uniqueId = millis() + uniqueIdCounter;
-  uniqueIdCounter++;
+  uniqueIdCounter += count;
 
-  print("Generated Unique ID: ",uniqueId);
+  logDebug("Generated Unique ID: ",uniqueId);
 
   return uniqueId;
 }
@@ -79,16 +74,15 @@ bool registerPeer(structure_peer getPeer) {
   peerInfo.encrypt = false;
 
   if (esp_now_add_peer(&peerInfo) != ESP_OK) {
-    print("Failed to add peer ", getPeer.label);
+    logError("Failed to add peer ", getPeer.label);
     return false;
   }
 
   return true;
 }
 
-int findOptionFromUniqueId(structure_option* options, int numOfItems, int uniqueId) {
+int findOptionFromUniqueId(const structure_option* options, int numOfItems, unsigned long uniqueId) {
   for (int i = 0; i < numOfItems; i++) {
-    print("Unique ID of item: ", options[i].uniqueId);
     if (options[i].uniqueId == uniqueId) {
       return i; // return the index of the value
     }
@@ -96,7 +90,7 @@ int findOptionFromUniqueId(structure_option* options, int numOfItems, int unique
   return -1; // not found
 }
 
-int findOptionFromUniqueId(std::vector<structure_option> options, int numOfItems, int uniqueId) {
+int findOptionFromUniqueId(const std::vector<structure_option>& options, int numOfItems, unsigned long uniqueId) {
   for (int i = 0; i < numOfItems; i++) {
     if (options[i].uniqueId == uniqueId) {
       return i; // return the index of the value
@@ -115,8 +109,11 @@ bool isValidValue(structure_option option, const int value) {
     case TYPE_RANGE:
       return isValidRange(option.rangeMin, option.rangeMax, value);
       break;
+    case TYPE_TELEMETRY:
+      return false; // read only, published by the client
+      break;
     default:
-      Serial.print("Unknown type sent");
+      logError("Unknown type sent");
       return false;
       break;
   };
@@ -133,18 +130,17 @@ bool isValidActive(int active) {
 }
 
 
-// request comms between devices
-bool sendRequest(byte macAddress[6], unsigned long uniqueId, int request, int value) {
+// request comms between devices - seq -1 sends a new frame, otherwise a retransmission
+bool sendRequest(AutoCCLink& link, byte macAddress[6], unsigned long uniqueId, int request, int value, uint32_t fingerprint, int seq) {
   structure_request newRequest;
   newRequest.flag         = FLAG_REQUEST;
   newRequest.uniqueId    = uniqueId;
   newRequest.request      = request;
   newRequest.value        = value;
+  newRequest.fingerprint  = fingerprint;
 
-  esp_err_t result = esp_now_send(macAddress, (uint8_t *)&newRequest, sizeof(newRequest));
+  uint8_t frame[MAX_FRAME_SIZE];
+  int len = encodeRequest(frame, sizeof(frame), newRequest);
 
-  if (result != ESP_OK) {
-    return false;
-  }
-  return true;
+  return link.send(macAddress, frame, len, seq);
 }
\ No newline at end of file
@@ -13,31 +13,42 @@
 #ifndef AutoCC_h
 #define AutoCC_h
 
+#include <vector>
 #include <Arduino.h>
 #include <esp_now.h>
+#include "AutoCCLog.h"
 
-// serial printing controllers for debugging
-#define DEBUGGING             true // Serial print flag
+// serial printing controllers for debugging, set LOG_LEVEL in AutoCCLog.h
+#define DEBUGGING             (LOG_LEVEL >= LOG_DEBUG) // print() flag
 
 #define ONLINE                true
 #define OFFLINE               false
 #define ON                    1
 #define OFF                   0
 
-#define SERVER_STARTUP_DELAY  3000    // start up the server after the devices
 
 // types of inputs - mainly used for auto validation
 #define TYPE_SWITCH           0
 #define TYPE_RANGE            1
+#define TYPE_TELEMETRY        2     // read only reading streamed by the client
 
 #define FLAG_OPTION           0
 #define FLAG_REQUEST          1
+#define FLAG_OPTION_BATCH     2
+#define FLAG_VALUE_BATCH      3
+#define FLAG_SET_VALUES       4
+#define FLAG_STREAM           5
 
 #define REQUEST_AWAKE         0
 #define REQUEST_COUNT         1
 #define REQUEST_OPTION        2
 #define REQUEST_SET_VALUE     3
 #define REQUEST_ALLOCATE_ID   4
+#define REQUEST_OPTION_BATCH  5
+#define REQUEST_VALUE_BATCH   6
+#define REQUEST_ANNOUNCE      7
+#define REQUEST_VALUE_CHANGED 8
+#define REQUEST_SET_VALUES    9
 
 #define DEVICE_SERVER         0
 #define DEVICE_CLIENT         1
@@ -54,6 +65,11 @@ struct structure_online_client {
     byte macAddress[6];        // MAC Address
     int numOfOptions;          // Num of Menu Options in that Peers
     bool isOnline;             // ONLINE or OFFLINE
+    unsigned long lastSeen;    // millis() of the last frame received from it
+    unsigned long nextProbe;   // millis() after which an offline client is probed again
+    unsigned long probeBackoff; // ms between probes while offline, doubles each miss
+    bool isProbing;            // REQUEST_AWAKE in flight
+    volatile bool hasAnnounced; // REQUEST_ANNOUNCE received, waiting for poll() to rediscover it
 };
 
 struct structure_option_setup {
@@ -82,33 +98,50 @@ struct structure_request {
     unsigned long uniqueId;   // unique id for tracking
     int request;               // REQUEST_XXX VARS
     int value;                 // additional values
+    uint32_t fingerprint;      // hash of the client's option setup, sent with REQUEST_COUNT replies
 };
 
-union comm_structures {  
-  struct structure_option option;
-  struct structure_request request;  
+/* FLAG_OPTION_BATCH frame header, followed by count packed options
+option k in the frame takes uniqueId + k as its unique id
+FLAG_VALUE_BATCH frames share the header, followed by count values
+FLAG_SET_VALUES frames share the header, followed by count uniqueId and value pairs
+FLAG_STREAM frames are the header and a count byte, followed by count uniqueId,
+value and age triples - age is the ms between the sample and the send
+*/
+struct structure_option_batch {
+    int count;                 // number of options in the frame
+    int startIndex;            // client index of the first option
+    unsigned long uniqueId;   // unique id of the request and the first option
+    unsigned long clientId;   // client unique id for tracking
 };
 
 
-// common helper functions
+// compile time FNV-1a hash of an option id, used to look options up without strcmp
+// e.g. constexpr uint32_t DRL_KEY = optionKey("drlstate");
+constexpr uint32_t optionKey(const char* id, uint32_t hash = 2166136261u) {
+  return (*id == '\0') ? hash : optionKey(id + 1, (uint32_t)((hash ^ (uint8_t)*id) * 16777619u));
+}
+
+// common helper functions - print() queues at LOG_DEBUG, so it's written by flushLog()
 void print(const char* message);
 void print(int number);
 void print(const char* message, int number);
 void print(int number, const char* message);
 void print(const char* message, const char* message2);
 
-unsigned long generateUniqueId();
+unsigned long generateUniqueId(int count = 1);
 void connectToWifi(const int deviceType);
 bool initESPNOW();
 bool registerPeer(structure_peer getPeer);
 
-int findOptionFromUniqueId(structure_option* options, int numOfItems, int uniqueId);
-int findOptionFromUniqueId(std::vector<structure_option> options, int numOfItems, int uniqueId);
+int findOptionFromUniqueId(const structure_option* options, int numOfItems, unsigned long uniqueId);
+int findOptionFromUniqueId(const std::vector<structure_option>& options, int numOfItems, unsigned long uniqueId);
 
 bool isValidValue(structure_option option, int value);
 bool isValidActive(int active);
 bool isValidRange(int rangeMin, int rangeMax, int value);
 
-bool sendRequest(byte macAddress[6], unsigned long uniqueId, int request, int value);
+class AutoCCLink;
+bool sendRequest(AutoCCLink& link, byte macAddress[6], unsigned long uniqueId, int request, int value, uint32_t fingerprint = 0, int seq = -1);
 
 #endif
\ No newline at end of file
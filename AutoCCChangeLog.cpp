@@ -0,0 +1,57 @@
+/*
+  AutoCCChangeLog.cpp
+
+  Andy Valentine - Valentine Autos
+
+  Bounded log of changes, kept by the server
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include "AutoCCChangeLog.h"
+
+// logs the change over the oldest one, returning its sequence number
+unsigned long AutoCCChangeLog::add(unsigned long uniqueId, int value, int kind) {
+  portENTER_CRITICAL(&_lock);
+  const unsigned long seq = ++_sequence;
+  _changes[seq % CHANGE_LOG_SIZE] = {seq, uniqueId, value, kind};
+  portEXIT_CRITICAL(&_lock);
+  return seq;
+}
+
+// the menu has changed shape, so anything older has to fetch the whole menu
+unsigned long AutoCCChangeLog::invalidate() {
+  portENTER_CRITICAL(&_lock);
+  const unsigned long seq = ++_sequence;
+  _snapshotSeq = seq;
+  portEXIT_CRITICAL(&_lock);
+  return seq;
+}
+
+unsigned long AutoCCChangeLog::sequence() {
+  portENTER_CRITICAL(&_lock);
+  const unsigned long seq = _sequence;
+  portEXIT_CRITICAL(&_lock);
+  return seq;
+}
+
+/* copies the changes after seq, oldest first, up to maxChanges - call
+again from the last one copied for the rest. Returns the number copied,
+or -1 if they are no longer all held and the whole menu is needed
+*/
+int AutoCCChangeLog::since(unsigned long seq, structure_change* changes, int maxChanges) {
+  int count = 0;
+
+  portENTER_CRITICAL(&_lock);
+  const unsigned long oldest = (_sequence > CHANGE_LOG_SIZE) ? _sequence - CHANGE_LOG_SIZE + 1 : 1;
+  const bool isHeld = seq >= _snapshotSeq && seq + 1 >= oldest && seq <= _sequence;
+  if (isHeld) {
+    for (unsigned long next = seq + 1; next <= _sequence && count < maxChanges; next++) {
+      changes[count++] = _changes[next % CHANGE_LOG_SIZE];
+    }
+  }
+  portEXIT_CRITICAL(&_lock);
+
+  return isHeld ? count : -1;
+}
@@ -0,0 +1,46 @@
+/*
+  AutoCCChangeLog.h
+
+  Andy Valentine - Valentine Autos
+
+  Bounded log of value changes and clients going on or offline, kept by
+  the server. Every change takes the next sequence number, so a UI can
+  ask for just the changes since the last one it saw. Once the ring has
+  wrapped past that, or the menu itself has changed, it has to fetch
+  the whole menu again
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#ifndef AutoCCChangeLog_h
+#define AutoCCChangeLog_h
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+
+#define CHANGE_LOG_SIZE       64    // changes kept
+#define CHANGE_VALUE          0     // a menu item's value changed
+#define CHANGE_CLIENT         1     // a client went ONLINE or OFFLINE
+
+struct structure_change {
+    unsigned long seq;         // sequence number of the change
+    unsigned long uniqueId;   // unique id of the menu item, or of the client for CHANGE_CLIENT
+    int value;                 // new value, or ONLINE / OFFLINE
+    int kind;                  // CHANGE_XXX
+};
+
+class AutoCCChangeLog {
+  public:
+    unsigned long add(unsigned long uniqueId, int value, int kind);
+    unsigned long invalidate();
+    unsigned long sequence();
+    int since(unsigned long seq, structure_change* changes, int maxChanges);
+  private:
+    structure_change _changes[CHANGE_LOG_SIZE];
+    unsigned long _sequence = 1;               // sequence number of the latest change
+    unsigned long _snapshotSeq = 1;            // changes at or before this need the whole menu
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+};
+
+#endif
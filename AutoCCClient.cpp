@@ -8,43 +8,76 @@
   Permission is hereby granted, free of charge, to any person obtaining a copy
   of this software and associated documentation files.
 */
+#include <algorithm>
 #include "AutoCCClient.h"
-#include <nvs.h>
-#include <nvs_flash.h>
 
 AutoCCClient* AutoCCClient::instance = nullptr; 
 
+// FNV-1a step over the four bytes of value
+static uint32_t hashInt(int value, uint32_t hash) {
+  for (int b = 0; b < 4; b++) {
+    hash = (hash ^ (uint8_t)(value >> (8 * b))) * 16777619u;
+  }
+  return hash;
+}
+
+// FNV-1a over everything in the setup table except the values, so it
+// only changes when the options themselves change
+static uint32_t setupFingerprint(const structure_option_setup* setup, int numOfOptions) {
+  uint32_t hash = hashInt(numOfOptions, 2166136261u);
+  for (int i = 0; i < numOfOptions; i++) {
+    hash = hashInt(0, optionKey(setup[i].id, hash)); // separates id from label
+    hash = optionKey(setup[i].label, hash);
+    hash = hashInt(setup[i].type, hash);
+    hash = hashInt(setup[i].rangeMin, hash);
+    hash = hashInt(setup[i].rangeMax, hash);
+  }
+  return hash;
+}
+
 AutoCCClient::AutoCCClient() {
   instance = this;
   Serial.begin(115200);
-  
-  esp_err_t err = nvs_flash_init();
-  if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-    nvs_flash_erase();
-    err = nvs_flash_init();
-  }
-  if (err != ESP_OK) {
-    Serial.println("Error initializing NVS");
-  }
+}
+
+// swap the NVS store for another - call before begin
+void AutoCCClient::setStore(AutoCCStore* store) {
+  _store = store;
 }
 
 bool AutoCCClient::begin(structure_peer* server, structure_option_setup* getOptions, int numOfOptions) {
   if (DEBUGGING) delay(1000); // stops initialisation being faster than Serial startup
   connectToWifi(DEVICE_CLIENT);
-  if (initESPNOW()) {
-    registerCallbacks();
+  const bool isConnected = initESPNOW();
+  if (isConnected) {
     if (registerPeer(server[0])) {
-      print("Server Registered");
+      logInfo("Server Registered");
        memcpy(_serverAddress, server[0].macAddress, 6);
     }
   }
+
+  if (numOfOptions <= 0) {
+    logError("Error intialising options");
+    return false;
+  }
+
   _numOfOptions = numOfOptions;
   options = new structure_option[_numOfOptions];
+  _optionKeys = new uint32_t[_numOfOptions];
+  _isDirty = new bool[_numOfOptions]();
+  _sampleTimes = new unsigned long[_numOfOptions]();
+  _isStreamPending = new bool[_numOfOptions]();
+  _isChangePending = new bool[_numOfOptions]();
+  _fingerprint = setupFingerprint(getOptions, _numOfOptions);
+
+  if (!_store->open()) {
+    logError("Error opening store, values will not be saved");
+  }
 
   // Copy the contents of the input array to the new array
   // and initialise new options
   for (int i = 0; i < _numOfOptions; i++) {
-    print("Loading ", getOptions[i].label);
+    logDebug("Loading ", getOptions[i].label);
 
     options[i].flag        = FLAG_OPTION;
     strcpy(options[i].memId, getOptions[i].id);
@@ -55,21 +88,30 @@ bool AutoCCClient::begin(structure_peer* server, structure_option_setup* getOpti
     options[i].rangeMax   = getOptions[i].rangeMax;
     options[i].uniqueId   = 0;
 
+    _optionKeys[i] = optionKey(options[i].memId);
+    if (getHandle(_optionKeys[i]).index != i) {
+      logError(options[i].memId, " shares its key with an earlier option");
+    }
+
+    // telemetry is published by the client rather than saved
     int result;
-    if (getMemory(i, result)) {
+    if (options[i].type == TYPE_TELEMETRY) {
+      options[i].value = getOptions[i].value;
+    } else if (getMemory(i, result)) {
       options[i].value = result;
     } else {
       storeMemory(i, getOptions[i].value);
       options[i].value = getOptions[i].value;
     }
-
-    if (i == (_numOfOptions - 1)) {
-      return true;
-    }
   }
+  flush(); // save any new defaults
 
-  print("Error intialising options");
-  return false;
+  // only start receiving once the options exist - the dispatcher then
+  // announces the client to the server straight away
+  if (isConnected) {
+    registerCallbacks();
+  }
+  return true;
 }
 
 // looks for the id and returns the value. Returns -1 if no match
@@ -80,46 +122,169 @@ int AutoCCClient::getValue(char getId[13]) {
         return options[i].value;
       }
    }
-   print(getId, " not found in options list");
+   logInfo(getId, " not found in options list");
    return -1;
 }
 
+/* Changes a value locally, e.g. from a physical switch, saves it and
+tells the server so its menu stays in step. Returns false if the id is
+not found or the value is not valid for the option
+*/
+bool AutoCCClient::setValue(char setId[13], int newValue) {
+  for (int i = 0; i < _numOfOptions; i++) {
+    if (strcmp(setId, options[i].memId) == 0) {
+      return setValue(structure_option_handle{i}, newValue);
+    }
+  }
+  logInfo(setId, " not found in options list");
+  return false;
+}
+
+bool AutoCCClient::setValue(structure_option_handle handle, int newValue) {
+  if (handle.index < 0 || handle.index >= _numOfOptions) return false;
+
+  if (!isValidValue(options[handle.index], newValue)) {
+    logInfo("Invalid value set");
+    return false;
+  }
+  if (!updateValue(handle.index, newValue)) return false;
+
+  notifyValueChanged(handle.index);
+  return true;
+}
+
+/* Publishes a reading of a TYPE_TELEMETRY option. Nothing is saved or
+acknowledged - the dispatcher sends the latest value of every published
+option in one FLAG_STREAM frame each STREAM_INTERVAL, so this is cheap
+enough to call on every sensor read
+*/
+bool AutoCCClient::publish(structure_option_handle handle, int value) {
+  if (handle.index < 0 || handle.index >= _numOfOptions) return false;
+  if (options[handle.index].type != TYPE_TELEMETRY) return false;
+
+  bool wasIdle;
+
+  portENTER_CRITICAL(&_streamLock);
+  wasIdle = !_hasStreamPending;
+  options[handle.index].value = value;
+  _sampleTimes[handle.index] = millis();
+  _isStreamPending[handle.index] = true;
+  _hasStreamPending = true;
+  portEXIT_CRITICAL(&_streamLock);
+
+  // wake the dispatcher so it starts the stream timer
+  if (wasIdle && _dispatcherTask != nullptr) {
+    xTaskNotifyGive(_dispatcherTask);
+  }
+  return true;
+}
+
+/* Resolves an option to a handle once, e.g. in setup
+getValue(handle) is then a single array read
+*/
+structure_option_handle AutoCCClient::getHandle(uint32_t key) {
+  for (int i = 0; i < _numOfOptions; i++) {
+    if (_optionKeys[i] == key) {
+      return {i};
+    }
+  }
+  logInfo("Option key not found in options list");
+  return {-1};
+}
+
+structure_option_handle AutoCCClient::getHandle(const char* id) {
+  return getHandle(optionKey(id));
+}
+
 /* NVS MEMORY READ AND WRITE */
 
+/* Values are written behind - storeMemory only marks the option as dirty,
+and the dispatcher commits every dirty option together once no change
+has come in for STORE_COMMIT_DELAY, or STORE_MAX_DELAY after the first
+*/
+
 // Store the value in NVS
 bool AutoCCClient::storeMemory(int optionIndex, int newValue) {
-  nvs_handle_t mem_store;
-  esp_err_t err = nvs_open("storage", NVS_READWRITE, &mem_store);
-  if (err == ESP_OK) {
-    err = nvs_set_i32(mem_store, options[optionIndex].memId, newValue);
-    if (err == ESP_OK) {
-      err = nvs_commit(mem_store);
-    }
-    return true;
-    nvs_close(mem_store);
+  bool wasClean;
+
+  portENTER_CRITICAL(&_storeLock);
+  wasClean = !_hasDirty;
+  options[optionIndex].value = newValue;
+  _isDirty[optionIndex] = true;
+  _hasDirty = true;
+  _lastStoreChange = millis();
+  if (wasClean) {
+    _firstStoreChange = _lastStoreChange;
   }
-  return false;
+  portEXIT_CRITICAL(&_storeLock);
+
+  // wake the dispatcher so it starts the commit timer
+  if (wasClean && _dispatcherTask != nullptr) {
+    xTaskNotifyGive(_dispatcherTask);
+  }
+  return true;
 }
 
 // Retrieve value from NVS
 bool AutoCCClient::getMemory(int optionIndex, int& response) {
-  nvs_handle_t mem_store;
-  esp_err_t err = nvs_open("storage", NVS_READWRITE, &mem_store);
-  if (err == ESP_OK) {
-    int32_t savedValue;
-    err = nvs_get_i32(mem_store, options[optionIndex].memId, &savedValue);
-    if (err == ESP_OK) {
-      print("Saved value is ", savedValue);
-      response = savedValue;
-      return true;
-    } 
-    nvs_close(mem_store);
-  } 
-  print("Error findind saved value");
+  int32_t savedValue;
+  if (_store->get(options[optionIndex].memId, savedValue)) {
+    logDebug("Saved value is ", savedValue);
+    response = savedValue;
+    return true;
+  }
+  logDebug("Error findind saved value");
   response = -1;
   return false;
 }
 
+// writes every dirty value and commits once - call before powering down
+bool AutoCCClient::flush() {
+  bool isSaved = true;
+  int numOfWritten = 0;
+
+  for (int i = 0; i < _numOfOptions; i++) {
+    bool isDirty;
+    int value;
+
+    portENTER_CRITICAL(&_storeLock);
+    isDirty = _isDirty[i];
+    _isDirty[i] = false;
+    value = options[i].value;
+    portEXIT_CRITICAL(&_storeLock);
+
+    if (isDirty) {
+      isSaved &= _store->set(options[i].memId, value);
+      numOfWritten++;
+    }
+  }
+
+  portENTER_CRITICAL(&_storeLock);
+  _hasDirty = false;
+  for (int i = 0; i < _numOfOptions; i++) {
+    _hasDirty |= _isDirty[i]; // changed while writing
+  }
+  portEXIT_CRITICAL(&_storeLock);
+
+  if (numOfWritten > 0) {
+    isSaved &= _store->commit();
+    logInfo("Values committed: ", numOfWritten);
+  }
+  return isSaved;
+}
+
+// ms until the dirty values are due to be committed, -1 if none are dirty
+long AutoCCClient::timeUntilFlush() {
+  portENTER_CRITICAL(&_storeLock);
+  const bool hasDirty = _hasDirty;
+  const unsigned long dueAt = std::min(_lastStoreChange + STORE_COMMIT_DELAY, _firstStoreChange + STORE_MAX_DELAY);
+  portEXIT_CRITICAL(&_storeLock);
+
+  if (!hasDirty) return -1;
+  const long remaining = (long)(dueAt - millis());
+  return remaining > 0 ? remaining : 0;
+}
+
 
 
 /* RECEIVED DATA CALLBACK HANDLING */
@@ -130,39 +295,100 @@ used when passing requests and single value responses
 void AutoCCClient::handleRequest(const structure_request sentRequest) {
   switch (sentRequest.request) {
     case REQUEST_AWAKE:
-      print("Awake request received");
+      logDebug("Awake request received");
       // only reset the unique id once
-      sendRequest(_serverAddress, sentRequest.uniqueId, REQUEST_AWAKE, ON); // respond that is awake with unique_id attached
+      reply(sentRequest.uniqueId, REQUEST_AWAKE, ON); // respond that is awake with unique_id attached
       break;
     case REQUEST_ALLOCATE_ID:
-      print("ID allocation received of ", sentRequest.uniqueId);
+      logDebug("ID allocation received of ", sentRequest.uniqueId);
       _clientUniqueId = sentRequest.uniqueId;
-      sendRequest(_serverAddress, sentRequest.uniqueId, REQUEST_ALLOCATE_ID, ON); // respond with new ID
+      _isAnnounced = true; // the server knows about the client
+      reply(sentRequest.uniqueId, REQUEST_ALLOCATE_ID, ON); // respond with new ID
+      break;
     case REQUEST_COUNT:
-      print("Count request received");
-      sendRequest(_serverAddress, sentRequest.uniqueId, REQUEST_COUNT, _numOfOptions); // respond with number of options
+      logDebug("Count request received");
+      // option k takes the request id + k, which a server with this setup cached keeps using
+      for (int i = 0; i < _numOfOptions; i++) {
+        options[i].uniqueId = sentRequest.uniqueId + i;
+        clearValueChange(i); // discovery reads every value afresh
+      }
+      reply(sentRequest.uniqueId, REQUEST_COUNT, _numOfOptions, _fingerprint); // respond with number of options
       break;
     case REQUEST_OPTION:
-      print("Option request received");
+      logDebug("Option request received");
       sendOption(sentRequest.uniqueId, sentRequest.value);
       break;
+    case REQUEST_OPTION_BATCH:
+      logDebug("Option batch request received");
+      sendOptionBatch(sentRequest.uniqueId, sentRequest.value);
+      break;
+    case REQUEST_VALUE_BATCH:
+      logDebug("Value batch request received");
+      sendValueBatch(sentRequest.uniqueId, sentRequest.value);
+      break;
+    case REQUEST_ANNOUNCE:
+      if (sentRequest.uniqueId == _announceId) {
+        logInfo("Announce acknowledged");
+        _isAnnounced = true;
+      }
+      break;
+    case REQUEST_VALUE_CHANGED:
+      acknowledgeValueChange(sentRequest.uniqueId, sentRequest.value);
+      break;
     case REQUEST_SET_VALUE:
-      print("Set Value request received");
+      logDebug("Set Value request received");
       if (tryUpdateValue(sentRequest.uniqueId, sentRequest.value)) {
-        sendRequest(_serverAddress, sentRequest.uniqueId, REQUEST_SET_VALUE, sentRequest.value); // send response that item is changed, otherwise, ignore and send nothing
+        reply(sentRequest.uniqueId, REQUEST_SET_VALUE, sentRequest.value); // send response that item is changed, otherwise, ignore and send nothing
       }
       break;
     default:
-      print("Unknown request type received");
+      logError("Unknown request type received");
       break;
   }
 };
 
+// answers the request being handled - the reply is kept by the link in case the request is sent again
+bool AutoCCClient::reply(unsigned long uniqueId, int request, int value, uint32_t fingerprint) {
+  structure_request newRequest;
+  newRequest.flag         = FLAG_REQUEST;
+  newRequest.uniqueId    = uniqueId;
+  newRequest.request      = request;
+  newRequest.value        = value;
+  newRequest.fingerprint  = fingerprint;
+
+  uint8_t frame[MAX_FRAME_SIZE];
+  int len = encodeRequest(frame, sizeof(frame), newRequest);
+  if (!_link.sendReply(_serverAddress, frame, len, _replySeq)) {
+    metrics.recordSendFailure(0);
+    return false;
+  }
+  return true;
+}
+
+/* REQUEST_ANNOUNCE tells the server the client has started, so the
+server picks up its options whichever of the two booted first. Sent by
+the dispatcher every ANNOUNCE_INTERVAL until the server answers
+*/
+void AutoCCClient::announce() {
+  _announceId = generateUniqueId();
+  _lastAnnounce = millis();
+  logInfo("Announcing to the server");
+  sendRequest(_link, _serverAddress, _announceId, REQUEST_ANNOUNCE, _numOfOptions, _fingerprint);
+}
+
+// ms until the next announce is due, -1 once the server has answered
+long AutoCCClient::timeUntilAnnounce() {
+  if (_isAnnounced) return -1;
+  if (_announceId == 0) return 0;
+  const long remaining = (long)(_lastAnnounce + ANNOUNCE_INTERVAL - millis());
+  return remaining > 0 ? remaining : 0;
+}
+
 /* handles FLAG_OPTION
 used when sending option values to the server
 */
 void AutoCCClient::sendOption(unsigned long uniqueId, int index) {
-  print("clientId attached is ", _clientUniqueId);
+  logDebug("clientId attached is ", _clientUniqueId);
 
   structure_option sendingOption;
   sendingOption               = options[index];
@@ -170,10 +396,77 @@ void AutoCCClient::sendOption(unsigned long uniqueId, int index) {
   sendingOption.clientId     = _clientUniqueId;
   options[index].uniqueId    = uniqueId; // set the unique id to the sent one for later lookups
 
-  esp_err_t result = esp_now_send(_serverAddress, (uint8_t *)& sendingOption, sizeof(sendingOption));
+  uint8_t frame[MAX_FRAME_SIZE];
+  int len = encodeOption(frame, sizeof(frame), sendingOption);
 
-  if (result != ESP_OK) {
-    print("Error sending option ", index);
+  if (!_link.sendReply(_serverAddress, frame, len, _replySeq)) {
+    logError("Error sending option ", index);
+  }
+}
+
+
+/* handles FLAG_OPTION_BATCH
+packs as many options from startIndex as fit into a single frame
+*/
+void AutoCCClient::sendOptionBatch(unsigned long uniqueId, int startIndex) {
+  uint8_t frame[MAX_FRAME_SIZE];
+  structure_option_batch batch;
+  batch.count       = 0;
+  batch.startIndex  = startIndex;
+  batch.uniqueId    = uniqueId;
+  batch.clientId    = _clientUniqueId;
+
+  AutoCCWriter writer(frame, sizeof(frame));
+  encodeBatchHeader(writer, batch);
+  int len = writer.length();
+
+  for (int i = startIndex; i < _numOfOptions && batch.count < 255; i++) {
+    AutoCCWriter optionWriter(frame + len, sizeof(frame) - len);
+    encodeOptionBody(optionWriter, options[i]);
+    if (optionWriter.hasOverflowed()) break; // frame full
+
+    options[i].uniqueId = uniqueId + batch.count; // set the unique id for later lookups
+    len += optionWriter.length();
+    batch.count++;
+  }
+  frame[BATCH_COUNT_OFFSET] = batch.count;
+
+  logDebug("Options in batch: ", batch.count);
+  if (!_link.sendReply(_serverAddress, frame, len, _replySeq)) {
+    logError("Error sending option batch from ", startIndex);
+  }
+}
+
+
+/* handles FLAG_VALUE_BATCH
+packs as many values from startIndex as fit into a single frame, used by
+a server restoring a cached menu
+*/
+void AutoCCClient::sendValueBatch(unsigned long uniqueId, int startIndex) {
+  uint8_t frame[MAX_FRAME_SIZE];
+  structure_option_batch batch;
+  batch.count       = 0;
+  batch.startIndex  = startIndex;
+  batch.uniqueId    = uniqueId;
+  batch.clientId    = _clientUniqueId;
+
+  AutoCCWriter writer(frame, sizeof(frame));
+  encodeBatchHeader(writer, batch, FLAG_VALUE_BATCH);
+  int len = writer.length();
+
+  for (int i = startIndex; i < _numOfOptions && batch.count < 255; i++) {
+    AutoCCWriter valueWriter(frame + len, sizeof(frame) - len);
+    valueWriter.putSigned(options[i].value);
+    if (valueWriter.hasOverflowed()) break; // frame full
+
+    len += valueWriter.length();
+    batch.count++;
+  }
+  frame[BATCH_COUNT_OFFSET] = batch.count;
+
+  logDebug("Values in batch: ", batch.count);
+  if (!_link.sendReply(_serverAddress, frame, len, _replySeq)) {
+    logError("Error sending value batch from ", startIndex);
   }
 }
 
@@ -187,39 +480,227 @@ bool AutoCCClient::tryUpdateValue(unsigned long uniqueId, int newValue) {
   if (optionIndex > -1) {
     if (isValidValue(options[optionIndex], newValue)) {
       if (updateValue(optionIndex, newValue)) {
-        print("New value successfully set");
+        clearValueChange(optionIndex); // the server's value replaces one it hasn't acknowledged
+        logDebug("New value successfully set");
         return true;  
       } else {
-        print("Error setting new value");
+        logError("Error setting new value");
         return false;  
       }
     } else {
-      print("Invalid value sent");
+      logDebug("Invalid value sent");
       return false;
     }
   } else {
-    print("Unique ID not found");
+    logDebug("Unique ID not found");
     return false;
   }
 }
 
+/* handles FLAG_SET_VALUES
+applies every pair in the frame, and replies once with a bitmask of the pairs applied
+*/
+void AutoCCClient::applyValues(const uint8_t* sentData, int len) {
+  AutoCCReader reader(sentData, len);
+  structure_option_batch batch;
+  if (!decodeBatchHeader(reader, batch, FLAG_SET_VALUES)) {
+    logError("Malformed set values received");
+    return;
+  }
+
+  uint32_t applied = 0;
+  for (int k = 0; k < batch.count && k < SET_VALUES_MAX; k++) {
+    const unsigned long uniqueId = reader.getVarint();
+    const int value = reader.getSigned();
+    if (reader.hasFailed()) {
+      logError("Set values truncated at ", k);
+      break;
+    }
+    if (tryUpdateValue(uniqueId, value)) {
+      applied |= 1u << k;
+    }
+  }
+
+  reply(batch.uniqueId, REQUEST_SET_VALUES, applied);
+}
+
 bool AutoCCClient::updateValue(int optionIndex, int newValue) {
     if (storeMemory(optionIndex, newValue)) {
-      options[optionIndex].value = newValue;
-
-      print("New value set to ", newValue);
+      logDebug("New value set to ", newValue);
       return true;
     };
 
-    print("Error saving to memory");
+    logError("Error saving to memory");
     return false;
 }
 
 
 
+/* REQUEST_VALUE_CHANGED tells the server a value changed on the client.
+The change stays pending until the server echoes the latest value back,
+and the dispatcher sends every pending change again each
+CHANGE_RETRY_INTERVAL, then each ANNOUNCE_INTERVAL after CHANGE_MAX_RETRIES.
+A resend carries the value at the time, so only the latest one is acknowledged
+*/
+void AutoCCClient::notifyValueChanged(int optionIndex) {
+  if (options[optionIndex].uniqueId == 0) return; // not yet known to the server, it gets the value on discovery
+
+  bool wasIdle;
+
+  portENTER_CRITICAL(&_changeLock);
+  wasIdle = !_hasChangePending;
+  _isChangePending[optionIndex] = true;
+  _hasChangePending = true;
+  _numOfChangeRetries = 0;
+  _lastChangeSend = millis();
+  portEXIT_CRITICAL(&_changeLock);
+
+  if (!sendRequest(_link, _serverAddress, options[optionIndex].uniqueId, REQUEST_VALUE_CHANGED, options[optionIndex].value)) {
+    logError("Error notifying the server of ", options[optionIndex].memId);
+  }
+
+  // wake the dispatcher so it starts the resend timer
+  if (wasIdle && _dispatcherTask != nullptr) {
+    xTaskNotifyGive(_dispatcherTask);
+  }
+}
+
+void AutoCCClient::resendValueChanges() {
+  portENTER_CRITICAL(&_changeLock);
+  _numOfChangeRetries++;
+  _lastChangeSend = millis();
+  portEXIT_CRITICAL(&_changeLock);
+
+  for (int i = 0; i < _numOfOptions; i++) {
+    portENTER_CRITICAL(&_changeLock);
+    const bool isPending = _isChangePending[i];
+    portEXIT_CRITICAL(&_changeLock);
+    if (!isPending) continue;
+
+    logDebug(options[i].memId, " change sent again");
+    metrics.recordRetry(0);
+    if (!sendRequest(_link, _serverAddress, options[i].uniqueId, REQUEST_VALUE_CHANGED, options[i].value)) {
+      metrics.recordSendFailure(0);
+    }
+  }
+}
+
+// the server's reply echoes the value it took, a change made since stays pending
+void AutoCCClient::acknowledgeValueChange(unsigned long uniqueId, int value) {
+  const int optionIndex = findOptionFromUniqueId(options, _numOfOptions, uniqueId);
+  if (optionIndex < 0 || options[optionIndex].value != value) return;
+
+  clearValueChange(optionIndex);
+  logDebug(options[optionIndex].memId, " change acknowledged");
+}
+
+void AutoCCClient::clearValueChange(int optionIndex) {
+  portENTER_CRITICAL(&_changeLock);
+  _isChangePending[optionIndex] = false;
+  _hasChangePending = false;
+  for (int i = 0; i < _numOfOptions; i++) {
+    _hasChangePending |= _isChangePending[i];
+  }
+  portEXIT_CRITICAL(&_changeLock);
+}
+
+// ms until pending changes are due to be sent again, -1 if none are pending
+long AutoCCClient::timeUntilChangeResend() {
+  portENTER_CRITICAL(&_changeLock);
+  const bool hasPending = _hasChangePending;
+  const unsigned long interval = (_numOfChangeRetries < CHANGE_MAX_RETRIES) ? CHANGE_RETRY_INTERVAL : ANNOUNCE_INTERVAL;
+  const unsigned long dueAt = _lastChangeSend + interval;
+  portEXIT_CRITICAL(&_changeLock);
+
+  if (!hasPending) return -1;
+  const long remaining = (long)(dueAt - millis());
+  return remaining > 0 ? remaining : 0;
+}
+
+
+
+/* TELEMETRY STREAM */
+
+/* handles FLAG_STREAM
+packs the latest value of each published option into one frame, sent
+with a sequence number but no acknowledgement. Options that don't fit
+are sent first in the next frame
+*/
+void AutoCCClient::sendStream() {
+  uint8_t frame[MAX_FRAME_SIZE];
+  AutoCCWriter writer(frame, sizeof(frame));
+  writer.putHeader(FLAG_STREAM);
+  writer.putByte(0); // count, filled in below
+  int len = writer.length();
+  int count = 0;
+  const unsigned long now = millis();
+
+  portENTER_CRITICAL(&_streamLock);
+  const int startIndex = _nextStreamIndex;
+  for (int k = 0; k < _numOfOptions && count < 255; k++) {
+    const int i = (startIndex + k) % _numOfOptions;
+    if (!_isStreamPending[i]) continue;
+    if (options[i].uniqueId == 0) { // not yet known to the server
+      _isStreamPending[i] = false;
+      continue;
+    }
+
+    AutoCCWriter sampleWriter(frame + len, sizeof(frame) - len);
+    sampleWriter.putVarint(options[i].uniqueId);
+    sampleWriter.putSigned(options[i].value);
+    sampleWriter.putVarint(now - _sampleTimes[i]);
+    if (sampleWriter.hasOverflowed()) { // frame full
+      _nextStreamIndex = i;
+      break;
+    }
+
+    len += sampleWriter.length();
+    _isStreamPending[i] = false;
+    count++;
+  }
+  _hasStreamPending = false;
+  for (int i = 0; i < _numOfOptions; i++) {
+    _hasStreamPending |= _isStreamPending[i]; // left over or published while packing
+  }
+  _lastStream = now;
+  portEXIT_CRITICAL(&_streamLock);
+
+  if (count == 0) return;
+  frame[BATCH_COUNT_OFFSET] = count;
+  if (!_link.send(_serverAddress, frame, len)) {
+    metrics.recordSendFailure(0);
+  }
+}
+
+// ms until the next stream frame is due, -1 if nothing has been published
+long AutoCCClient::timeUntilStream() {
+  portENTER_CRITICAL(&_streamLock);
+  const bool hasPending = _hasStreamPending;
+  const unsigned long dueAt = _lastStream + STREAM_INTERVAL;
+  portEXIT_CRITICAL(&_streamLock);
+
+  if (!hasPending) return -1;
+  const long remaining = (long)(dueAt - millis());
+  return remaining > 0 ? remaining : 0;
+}
+
+
+
+// counters from metrics, with the receive queue and link figures filled in
+void AutoCCClient::getMetrics(structure_metrics& snapshot) {
+  metrics.snapshot(snapshot);
+  snapshot.numOfDuplicates    = _link.numOfDuplicates();
+  snapshot.numOfDroppedFrames = receiveQueue.numOfDropped();
+  snapshot.queueDepth         = receiveQueue.size();
+  snapshot.queueHighWaterMark = receiveQueue.highWaterMark();
+}
+
 /* ESP-NOW CALLBACK FUNCTIONS */
 
 void AutoCCClient::registerCallbacks() {
+  if (_dispatcherTask == nullptr) {
+    xTaskCreate(dispatchTask, "AutoCCClient", DISPATCH_STACK_SIZE, this, DISPATCH_PRIORITY, &_dispatcherTask);
+  }
   esp_now_register_send_cb(onDataSent);
   esp_now_register_recv_cb(onDataRecv);
 }
@@ -227,22 +708,86 @@ void AutoCCClient::registerCallbacks() {
 
 /* NOTE: MUST BE static functions */
 void AutoCCClient::onDataSent(const uint8_t *mac_addr, esp_now_send_status_t status) {
-  print("Last Packet Send Status: ", status == ESP_NOW_SEND_SUCCESS ? "Success" : "Fail");
+  logDebug("Last Packet Send Status: ", status == ESP_NOW_SEND_SUCCESS ? "Success" : "Fail");
+  if (status != ESP_NOW_SEND_SUCCESS) {
+    instance->metrics.recordSendFailure(0);
+  }
 }
 
+// runs in the WiFi task - only copies the frame out and wakes the dispatcher
 void AutoCCClient::onDataRecv(const esp_now_recv_info *recvInfo, const uint8_t *sentData, int len) {
-    int flag = sentData[0]; // Extract the flag from the received data
+    if (!instance->receiveQueue.push(recvInfo->src_addr, sentData, len)) {
+      return; // counted in receiveQueue.numOfDropped()
+    }
+    xTaskNotifyGive(instance->_dispatcherTask);
+}
+
+// drains the receive queue in batches, yielding between them
+void AutoCCClient::dispatchTask(void* parameter) {
+  AutoCCClient* self = static_cast<AutoCCClient*>(parameter);
+  for (;;) {
+    // sleep until a frame arrives, or dirty values, an announce, a stream frame or a change resend are due
+    long untilWork = -1;
+    for (long until : {self->timeUntilFlush(), self->timeUntilAnnounce(), self->timeUntilStream(), self->timeUntilChangeResend()}) {
+      if (until >= 0 && (untilWork < 0 || until < untilWork)) {
+        untilWork = until;
+      }
+    }
+    ulTaskNotifyTake(pdTRUE, (untilWork < 0) ? portMAX_DELAY : pdMS_TO_TICKS(untilWork));
+
+    structure_frame* frame;
+    int numOfHandled = 0;
+    while ((frame = self->receiveQueue.front()) != nullptr) {
+      self->handleFrame(*frame);
+      self->receiveQueue.pop();
 
-    comm_structures receivedData; // format received data
-    memcpy(&receivedData, sentData, len);
+      if (++numOfHandled % DISPATCH_BATCH == 0) {
+        taskYIELD();
+      }
+    }
+
+    if (self->timeUntilFlush() == 0) {
+      self->flush();
+    }
+    if (self->timeUntilAnnounce() == 0) {
+      self->announce();
+    }
+    if (self->timeUntilStream() == 0) {
+      self->sendStream();
+    }
+    if (self->timeUntilChangeResend() == 0) {
+      self->resendValueChanges();
+    }
+  }
+}
+
+void AutoCCClient::handleFrame(const structure_frame& frame) {
+    const uint8_t* sentData = frame.data;
+    const int len = frame.len;
+
+    // a request sent again is answered from the link's reply cache
+    if (!_link.accept(frame.macAddress, sentData, len)) return;
+    _replySeq = frameSeq(sentData, len);
+
+    int flag = frameFlag(sentData, len); // Extract the flag from the received data
 
     // Handle different structure types based on the flag
     switch (flag) {
-      case FLAG_REQUEST:
-        instance->handleRequest(receivedData.request);
+      case FLAG_REQUEST: {
+        structure_request request;
+        if (decodeRequest(sentData, len, request)) {
+          handleRequest(request);
+        } else {
+          logError("Malformed request received");
+        }
+        break;
+      }
+      case FLAG_SET_VALUES:
+        applyValues(sentData, len);
         break;
       default:
-        print("Unknown structure type received");
+        logError("Unknown structure type received");
+        metrics.recordUnknownFrame();
         break;
     }
 }
\ No newline at end of file
@@ -13,31 +13,107 @@
 
 #include <Preferences.h>
 #include "AutoCC.h"
+#include "AutoCCCodec.h"
+#include "AutoCCLink.h"
+#include "AutoCCMetrics.h"
+#include "AutoCCReceiveQueue.h"
+#include "AutoCCStore.h"
+
+#define STORE_COMMIT_DELAY    500   // ms without changes before values are committed
+#define STORE_MAX_DELAY       5000  // ms a changed value can wait to be committed
+#define ANNOUNCE_INTERVAL     1000  // ms between announces until the server answers
+#define STREAM_INTERVAL       10    // ms between FLAG_STREAM frames, samples published in between are coalesced
+#define CHANGE_RETRY_INTERVAL 50    // ms before an unacknowledged value change is sent again
+#define CHANGE_MAX_RETRIES    5     // quick resends, after which changes are sent again every ANNOUNCE_INTERVAL
+
+// option resolved to its index once, so reading it needs no lookup
+struct structure_option_handle {
+    int index;                 // index in options, -1 if not found
+};
 
 class AutoCCClient {
   public:
     AutoCCClient();
     bool begin(structure_peer* server, structure_option_setup* getOptions, int numOfOptions);
     int getValue(char getId[13]);
+    void setStore(AutoCCStore* store);
+    bool flush();
+    structure_option_handle getHandle(uint32_t key);
+    structure_option_handle getHandle(const char* id);
+    int getValue(structure_option_handle handle) {
+      return (handle.index >= 0) ? options[handle.index].value : -1;
+    }
+    bool setValue(char setId[13], int newValue);
+    bool setValue(structure_option_handle handle, int newValue);
+    bool publish(structure_option_handle handle, int value);
     structure_option* options;
+    AutoCCReceiveQueue receiveQueue;
+    AutoCCMetrics metrics;                     // the server is peer 0
+    void getMetrics(structure_metrics& snapshot);
   private:
     Preferences preferences;
     byte _serverAddress[6];
     int _numOfOptions = 0;
+    uint32_t* _optionKeys = nullptr;           // optionKey of each option's id
+    
+    AutoCCNVSStore _nvsStore;
+    AutoCCStore* _store = &_nvsStore;
+    bool* _isDirty = nullptr;                  // value changed since the last commit
+    bool _hasDirty = false;
+    unsigned long _firstStoreChange = 0;
+    unsigned long _lastStoreChange = 0;
+    portMUX_TYPE _storeLock = portMUX_INITIALIZER_UNLOCKED;
+
+    unsigned long* _sampleTimes = nullptr;     // millis() each telemetry value was published at
+    bool* _isStreamPending = nullptr;          // telemetry value published since the last stream frame
+    bool _hasStreamPending = false;
+    int _nextStreamIndex = 0;                  // first option checked by the next stream frame
+    unsigned long _lastStream = 0;
+    portMUX_TYPE _streamLock = portMUX_INITIALIZER_UNLOCKED;
+
+    bool* _isChangePending = nullptr;          // value changed on the client and not yet acknowledged by the server
+    bool _hasChangePending = false;
+    int _numOfChangeRetries = 0;               // resends since the last new change
+    unsigned long _lastChangeSend = 0;
+    portMUX_TYPE _changeLock = portMUX_INITIALIZER_UNLOCKED;
+
     unsigned long _clientUniqueId = 0;
+    AutoCCLink _link;
+    int _replySeq = -1;                        // sequence number of the request being handled
+    uint32_t _fingerprint = 0;                 // hash of the option setup, lets the server reuse a cached menu
+    bool _isAnnounced = false;                 // server has answered an announce or started discovery
+    unsigned long _announceId = 0;             // id of the last announce, 0 before the first
+    unsigned long _lastAnnounce = 0;
     
     void handleRequest(const structure_request sentRequest);
+    bool reply(unsigned long uniqueId, int request, int value, uint32_t fingerprint = 0);
+    void announce();
+    long timeUntilAnnounce();
     void sendOption(unsigned long uniqueId, int index);
+    void sendOptionBatch(unsigned long uniqueId, int startIndex);
+    void sendValueBatch(unsigned long uniqueId, int startIndex);
 
     bool tryUpdateValue(unsigned long uniqueId, int newValue);
+    void applyValues(const uint8_t* sentData, int len);
     bool updateValue(int optionIndex, int newValue);
+    void notifyValueChanged(int optionIndex);
+    void resendValueChanges();
+    void acknowledgeValueChange(unsigned long uniqueId, int value);
+    void clearValueChange(int optionIndex);
+    long timeUntilChangeResend();
+    void sendStream();
+    long timeUntilStream();
 
     bool storeMemory(int optionIndex, int newValue);
     bool getMemory(int optionIndex, int& response);
+    long timeUntilFlush();
 
     void registerCallbacks();
     static void onDataSent(const uint8_t *mac_addr, esp_now_send_status_t status);
     static void onDataRecv(const esp_now_recv_info *recvInfo, const uint8_t *sentData, int len);
+    static void dispatchTask(void* parameter);
+    void handleFrame(const structure_frame& frame);
+    TaskHandle_t _dispatcherTask = nullptr;
     static AutoCCClient* instance;
 };
 
@@ -0,0 +1,219 @@
+/*
+  AutoCCCodec.cpp
+
+  Andy Valentine - Valentine Autos
+
+  Wire encoding shared between the client and the server systems
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include "AutoCCCodec.h"
+
+/* WRITER */
+
+AutoCCWriter::AutoCCWriter(uint8_t* buffer, int size) : _buffer(buffer), _size(size) {}
+
+// the sequence number is left empty for AutoCCLink to stamp
+void AutoCCWriter::putHeader(int flag) {
+  putByte((PROTOCOL_VERSION << 4) | (flag & 0x0F));
+  putByte(0);
+  putByte(0);
+}
+
+void AutoCCWriter::putByte(uint8_t value) {
+  if (_used >= _size) {
+    _overflowed = true;
+    return;
+  }
+  _buffer[_used++] = value;
+}
+
+// 7 bits per byte, high bit set while more bytes follow
+void AutoCCWriter::putVarint(uint32_t value) {
+  while (value >= 0x80) {
+    putByte((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  putByte(value);
+}
+
+// zigzag so small negative numbers stay small
+void AutoCCWriter::putSigned(int32_t value) {
+  putVarint(((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+}
+
+// length prefixed, never more than maxLen - 1 characters
+void AutoCCWriter::putString(const char* text, int maxLen) {
+  int textLen = strnlen(text, maxLen - 1);
+  putByte(textLen);
+  if (_used + textLen > _size) {
+    _overflowed = true;
+    return;
+  }
+  memcpy(_buffer + _used, text, textLen);
+  _used += textLen;
+}
+
+int AutoCCWriter::length() const {
+  return _overflowed ? 0 : _used;
+}
+
+bool AutoCCWriter::hasOverflowed() const {
+  return _overflowed;
+}
+
+
+/* READER */
+
+AutoCCReader::AutoCCReader(const uint8_t* buffer, int len) : _buffer(buffer), _len(len) {}
+
+int AutoCCReader::getHeader() {
+  uint8_t header = getByte();
+  getByte(); // sequence number, handled by AutoCCLink
+  getByte();
+  if (_failed || (header >> 4) != PROTOCOL_VERSION) {
+    _failed = true;
+    return -1;
+  }
+  return header & 0x0F;
+}
+
+uint8_t AutoCCReader::getByte() {
+  if (_used >= _len) {
+    _failed = true;
+    return 0;
+  }
+  return _buffer[_used++];
+}
+
+uint32_t AutoCCReader::getVarint() {
+  uint32_t value = 0;
+  for (int shift = 0; shift < 7 * MAX_VARINT_SIZE; shift += 7) {
+    uint8_t part = getByte();
+    value |= (uint32_t)(part & 0x7F) << shift;
+    if (!(part & 0x80)) return value;
+  }
+  _failed = true; // too long for 32 bits
+  return 0;
+}
+
+int32_t AutoCCReader::getSigned() {
+  uint32_t value = getVarint();
+  return (int32_t)((value >> 1) ^ (~(value & 1) + 1));
+}
+
+void AutoCCReader::getString(char* text, int maxLen) {
+  int textLen = getByte();
+  if (textLen > maxLen - 1 || _used + textLen > _len) {
+    _failed = true;
+    text[0] = '\0';
+    return;
+  }
+  memcpy(text, _buffer + _used, textLen);
+  text[textLen] = '\0';
+  _used += textLen;
+}
+
+int AutoCCReader::position() const {
+  return _used;
+}
+
+bool AutoCCReader::hasFailed() const {
+  return _failed;
+}
+
+
+/* FRAMES */
+
+int frameFlag(const uint8_t* data, int len) {
+  if (len < 1 || (data[0] >> 4) != PROTOCOL_VERSION) return -1;
+  return data[0] & 0x0F;
+}
+
+int frameSeq(const uint8_t* data, int len) {
+  if (len < FRAME_HEADER_SIZE || (data[0] >> 4) != PROTOCOL_VERSION) return -1;
+  return data[FRAME_SEQ_OFFSET] | (data[FRAME_SEQ_OFFSET + 1] << 8);
+}
+
+void stampSeq(uint8_t* data, uint16_t seq) {
+  data[FRAME_SEQ_OFFSET] = seq & 0xFF;
+  data[FRAME_SEQ_OFFSET + 1] = seq >> 8;
+}
+
+int encodeRequest(uint8_t* buffer, int size, const structure_request& request) {
+  AutoCCWriter writer(buffer, size);
+  writer.putHeader(FLAG_REQUEST);
+  writer.putVarint(request.uniqueId);
+  writer.putVarint(request.request);
+  writer.putSigned(request.value);
+  writer.putVarint(request.fingerprint);
+  return writer.length();
+}
+
+int decodeRequest(const uint8_t* buffer, int len, structure_request& request) {
+  AutoCCReader reader(buffer, len);
+  if (reader.getHeader() != FLAG_REQUEST) return 0;
+  request.flag      = FLAG_REQUEST;
+  request.uniqueId  = reader.getVarint();
+  request.request   = reader.getVarint();
+  request.value     = reader.getSigned();
+  request.fingerprint = reader.getVarint();
+  return reader.hasFailed() ? 0 : reader.position();
+}
+
+int encodeOption(uint8_t* buffer, int size, const structure_option& option) {
+  AutoCCWriter writer(buffer, size);
+  writer.putHeader(FLAG_OPTION);
+  writer.putVarint(option.uniqueId);
+  writer.putVarint(option.clientId);
+  encodeOptionBody(writer, option);
+  return writer.length();
+}
+
+int decodeOption(const uint8_t* buffer, int len, structure_option& option) {
+  AutoCCReader reader(buffer, len);
+  if (reader.getHeader() != FLAG_OPTION) return 0;
+  option.uniqueId = reader.getVarint();
+  option.clientId = reader.getVarint();
+  decodeOptionBody(reader, option);
+  return reader.hasFailed() ? 0 : reader.position();
+}
+
+void encodeBatchHeader(AutoCCWriter& writer, const structure_option_batch& batch, int flag) {
+  writer.putHeader(flag);
+  writer.putByte(batch.count);
+  writer.putVarint(batch.startIndex);
+  writer.putVarint(batch.uniqueId);
+  writer.putVarint(batch.clientId);
+}
+
+bool decodeBatchHeader(AutoCCReader& reader, structure_option_batch& batch, int flag) {
+  if (reader.getHeader() != flag) return false;
+  batch.count       = reader.getByte();
+  batch.startIndex  = reader.getVarint();
+  batch.uniqueId    = reader.getVarint();
+  batch.clientId    = reader.getVarint();
+  return !reader.hasFailed();
+}
+
+// type, rangeMin, rangeMax, value, memId, label
+void encodeOptionBody(AutoCCWriter& writer, const structure_option& option) {
+  writer.putVarint(option.type);
+  writer.putSigned(option.rangeMin);
+  writer.putSigned(option.rangeMax);
+  writer.putSigned(option.value);
+  writer.putString(option.memId, sizeof(option.memId));
+  writer.putString(option.label, sizeof(option.label));
+}
+
+void decodeOptionBody(AutoCCReader& reader, structure_option& option) {
+  option.flag       = FLAG_OPTION;
+  option.type       = reader.getVarint();
+  option.rangeMin  = reader.getSigned();
+  option.rangeMax  = reader.getSigned();
+  option.value      = reader.getSigned();
+  reader.getString(option.memId, sizeof(option.memId));
+  reader.getString(option.label, sizeof(option.label));
+}
@@ -0,0 +1,91 @@
+/*
+  AutoCCCodec.h
+
+  Andy Valentine - Valentine Autos
+
+  Wire encoding shared between the client and the server systems.
+  Every frame starts with a header byte holding the protocol version
+  and the FLAG_XXX type, and a 16 bit sequence number filled in by
+  AutoCCLink, followed by varint integers and length prefixed strings,
+  so frames no longer depend on struct layout
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#ifndef AutoCCCodec_h
+#define AutoCCCodec_h
+
+#include "AutoCC.h"
+
+#define PROTOCOL_VERSION      3
+
+#define MAX_FRAME_SIZE        ESP_NOW_MAX_DATA_LEN  // 250 bytes per ESP-NOW frame
+#define MAX_VARINT_SIZE       5                     // 32 bit value, 7 bits per byte
+#define FRAME_SEQ_OFFSET      1                     // sequence number follows the header byte
+#define FRAME_HEADER_SIZE     3                     // header byte and sequence number
+#define BATCH_COUNT_OFFSET    FRAME_HEADER_SIZE     // count byte follows the header in batch frames
+#define SET_VALUES_MAX        20                    // uniqueId and value pairs that always fit in a FLAG_SET_VALUES frame
+#define MAX_OPTION_BODY_SIZE  (4 * MAX_VARINT_SIZE + 2 + 13 + 32) // encodeOptionBody of a full option
+
+// sequential writer into a caller supplied buffer
+// once anything fails to fit, the writer is marked as overflowed and
+// length() returns 0
+class AutoCCWriter {
+  public:
+    AutoCCWriter(uint8_t* buffer, int size);
+    void putHeader(int flag);
+    void putByte(uint8_t value);
+    void putVarint(uint32_t value);
+    void putSigned(int32_t value);
+    void putString(const char* text, int maxLen);
+    int length() const;
+    bool hasOverflowed() const;
+  private:
+    uint8_t* _buffer;
+    int _size;
+    int _used = 0;
+    bool _overflowed = false;
+};
+
+// sequential reader over a received frame
+// reads past the end or malformed fields mark the reader as failed
+class AutoCCReader {
+  public:
+    AutoCCReader(const uint8_t* buffer, int len);
+    int getHeader();
+    uint8_t getByte();
+    uint32_t getVarint();
+    int32_t getSigned();
+    void getString(char* text, int maxLen);
+    int position() const;
+    bool hasFailed() const;
+  private:
+    const uint8_t* _buffer;
+    int _len;
+    int _used = 0;
+    bool _failed = false;
+};
+
+// returns the FLAG_XXX of a frame, or -1 if empty or from another protocol version
+int frameFlag(const uint8_t* data, int len);
+
+// sequence number of a frame, or -1 if too short or from another protocol version
+int frameSeq(const uint8_t* data, int len);
+void stampSeq(uint8_t* data, uint16_t seq);
+
+// whole frames - return the bytes used, or 0 on failure
+int encodeRequest(uint8_t* buffer, int size, const structure_request& request);
+int decodeRequest(const uint8_t* buffer, int len, structure_request& request);
+int encodeOption(uint8_t* buffer, int size, const structure_option& option);
+int decodeOption(const uint8_t* buffer, int len, structure_option& option);
+
+// batch frames are a header followed by count option bodies, or count values
+void encodeBatchHeader(AutoCCWriter& writer, const structure_option_batch& batch, int flag = FLAG_OPTION_BATCH);
+bool decodeBatchHeader(AutoCCReader& reader, structure_option_batch& batch, int flag = FLAG_OPTION_BATCH);
+
+// option fields without the frame header or ids
+void encodeOptionBody(AutoCCWriter& writer, const structure_option& option);
+void decodeOptionBody(AutoCCReader& reader, structure_option& option);
+
+#endif
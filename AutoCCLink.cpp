@@ -0,0 +1,135 @@
+/*
+  AutoCCLink.cpp
+
+  Andy Valentine - Valentine Autos
+
+  Reliability layer between the system and ESP-NOW
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include "AutoCCLink.h"
+
+// takes the next sequence number for a new frame to the peer
+uint16_t AutoCCLink::reserveSeq(const byte macAddress[6]) {
+  uint16_t seq = 0;
+  portENTER_CRITICAL(&_lock);
+  structure_link_peer* peer = findPeer(macAddress);
+  if (peer != nullptr) {
+    seq = peer->nextSeq++;
+  }
+  portEXIT_CRITICAL(&_lock);
+  return seq;
+}
+
+// seq -1 sends the frame as a new one, otherwise it's a retransmission under seq
+bool AutoCCLink::send(const byte macAddress[6], uint8_t* frame, int len, int seq) {
+  if (len <= 0) return false;
+
+  stampSeq(frame, (seq < 0) ? reserveSeq(macAddress) : seq);
+  return esp_now_send(macAddress, frame, len) == ESP_OK;
+}
+
+// sends a new frame answering requestSeq, and keeps it in case the request is retransmitted
+bool AutoCCLink::sendReply(const byte macAddress[6], uint8_t* frame, int len, int requestSeq) {
+  if (len <= 0) return false;
+  stampSeq(frame, reserveSeq(macAddress));
+
+  if (requestSeq >= 0) {
+    portENTER_CRITICAL(&_lock);
+    structure_cached_reply& reply = _replies[_nextReply];
+    _nextReply = (_nextReply + 1) % REPLY_CACHE_SIZE;
+    memcpy(reply.macAddress, macAddress, 6);
+    reply.requestSeq = requestSeq;
+    reply.len = len;
+    memcpy(reply.frame, frame, len);
+    portEXIT_CRITICAL(&_lock);
+  }
+
+  return esp_now_send(macAddress, frame, len) == ESP_OK;
+}
+
+/* false if the frame has been received before, and should be dropped
+a retransmitted request that was already answered gets the cached reply again
+*/
+bool AutoCCLink::accept(const byte macAddress[6], const uint8_t* frame, int len) {
+  const int seq = frameSeq(frame, len);
+  if (seq < 0) return true; // not ours, left for the decoder to reject
+
+  uint8_t reply[MAX_FRAME_SIZE];
+  int replyLen = 0;
+  bool isNew = true;
+
+  portENTER_CRITICAL(&_lock);
+  structure_link_peer* peer = findPeer(macAddress);
+  if (peer != nullptr && isDuplicate(*peer, seq)) {
+    isNew = false;
+    _numOfDuplicates++;
+    for (int k = 0; k < REPLY_CACHE_SIZE; k++) {
+      const structure_cached_reply& cached = _replies[k];
+      if (cached.len > 0 && cached.requestSeq == seq && memcmp(cached.macAddress, macAddress, 6) == 0) {
+        replyLen = cached.len;
+        memcpy(reply, cached.frame, replyLen);
+        break;
+      }
+    }
+  }
+  portEXIT_CRITICAL(&_lock);
+
+  if (replyLen > 0) {
+    esp_now_send(macAddress, reply, replyLen);
+  }
+  return isNew;
+}
+
+int AutoCCLink::numOfDuplicates() const {
+  return _numOfDuplicates;
+}
+
+
+
+/* PEERS - lock must be held */
+
+// finds the peer, adding it if new - nullptr once LINK_MAX_PEERS are known
+structure_link_peer* AutoCCLink::findPeer(const byte macAddress[6]) {
+  for (int i = 0; i < _numOfPeers; i++) {
+    if (memcmp(_peers[i].macAddress, macAddress, 6) == 0) {
+      return &_peers[i];
+    }
+  }
+  if (_numOfPeers >= LINK_MAX_PEERS) return nullptr;
+
+  structure_link_peer& peer = _peers[_numOfPeers++];
+  memcpy(peer.macAddress, macAddress, 6);
+  peer.nextSeq = esp_random(); // a restarted device doesn't reuse the numbers its peers remember
+  peer.highestSeq = 0;
+  peer.seenMask = 0;
+  peer.hasReceived = false;
+  return &peer;
+}
+
+/* Sliding window over the last LINK_WINDOW_SIZE sequence numbers. Anything
+further back than the window is taken as the peer having restarted
+*/
+bool AutoCCLink::isDuplicate(structure_link_peer& peer, uint16_t seq) {
+  const int16_t ahead = (int16_t)(seq - peer.highestSeq);
+
+  if (!peer.hasReceived || ahead >= LINK_WINDOW_SIZE || -ahead >= LINK_WINDOW_SIZE) {
+    peer.hasReceived = true;
+    peer.highestSeq = seq;
+    peer.seenMask = 1;
+    return false;
+  }
+
+  if (ahead > 0) {
+    peer.seenMask = (peer.seenMask << ahead) | 1;
+    peer.highestSeq = seq;
+    return false;
+  }
+
+  const uint32_t bit = 1u << -ahead;
+  if (peer.seenMask & bit) return true;
+  peer.seenMask |= bit;
+  return false;
+}
@@ -0,0 +1,60 @@
+/*
+  AutoCCLink.h
+
+  Andy Valentine - Valentine Autos
+
+  Reliability layer between the system and ESP-NOW. Every frame carries
+  a per peer sequence number, so a receiver can drop frames it has
+  already handled, and answers a retransmitted request by sending its
+  cached reply again rather than handling the request twice
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#ifndef AutoCCLink_h
+#define AutoCCLink_h
+
+#include <Arduino.h>
+#include <esp_now.h>
+#include "AutoCCCodec.h"
+
+#define LINK_MAX_PEERS        20    // peers sequence numbers are kept for
+#define LINK_WINDOW_SIZE      32    // recent sequence numbers remembered per peer
+#define REPLY_CACHE_SIZE      8     // replies kept to answer retransmitted requests
+
+struct structure_link_peer {
+    byte macAddress[6];        // 6 part macAddress
+    uint16_t nextSeq;          // sequence number of the next new frame to the peer
+    uint16_t highestSeq;       // highest sequence number received from the peer
+    uint32_t seenMask;         // bit k set once highestSeq - k has been received
+    bool hasReceived;          // anything received from the peer yet
+};
+
+struct structure_cached_reply {
+    byte macAddress[6];        // peer the reply was sent to
+    uint16_t requestSeq;       // sequence number of the request it answered
+    int len;                   // length of frame, 0 if unused
+    uint8_t frame[MAX_FRAME_SIZE];
+};
+
+class AutoCCLink {
+  public:
+    uint16_t reserveSeq(const byte macAddress[6]);
+    bool send(const byte macAddress[6], uint8_t* frame, int len, int seq = -1);
+    bool sendReply(const byte macAddress[6], uint8_t* frame, int len, int requestSeq);
+    bool accept(const byte macAddress[6], const uint8_t* frame, int len);
+    int numOfDuplicates() const;
+  private:
+    structure_link_peer _peers[LINK_MAX_PEERS];
+    int _numOfPeers = 0;
+    structure_cached_reply _replies[REPLY_CACHE_SIZE] = {};
+    int _nextReply = 0;
+    int _numOfDuplicates = 0;
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+
+    structure_link_peer* findPeer(const byte macAddress[6]);
+    bool isDuplicate(structure_link_peer& peer, uint16_t seq);
+};
+
+#endif
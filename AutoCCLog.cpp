@@ -0,0 +1,149 @@
+/*
+  AutoCCLog.cpp
+
+  Andy Valentine - Valentine Autos
+
+  Deferred logger, written to Serial by flushLog()
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include <freertos/FreeRTOS.h>
+#include "AutoCCLog.h"
+
+#define NUMBER_NONE           0
+#define NUMBER_BEFORE         1
+#define NUMBER_AFTER          2
+
+// one queued line - text is copied in, the number is only formatted when flushed
+struct structure_log_line {
+    uint8_t level;             // LOG_XXX
+    uint8_t numberAt;          // NUMBER_XXX, where the number goes around text
+    bool isUnsigned;           // number is an unsigned long, e.g. a uniqueId
+    long number;               // number logged with the text
+    char text[LOG_TEXT_SIZE];  // message and message2, cut to fit
+};
+
+static structure_log_line logLines[LOG_BUFFER_SIZE];
+static int logHead = 0;                    // next line to flush
+static int logCount = 0;
+static unsigned long logDropped = 0;
+static portMUX_TYPE logLock = portMUX_INITIALIZER_UNLOCKED;
+
+// copies as much of text as fits after used characters, returning the new length
+static int appendText(char* text, int used, const char* message) {
+  while (message != nullptr && *message != '\0' && used < LOG_TEXT_SIZE - 1) {
+    text[used++] = *message++;
+  }
+  text[used] = '\0';
+  return used;
+}
+
+// claims a slot and fills it in under the lock, so any task or callback can log
+static void queueLine(int level, const char* message, const char* message2, long number, int numberAt, bool isUnsigned = false) {
+  portENTER_CRITICAL(&logLock);
+  if (logCount < LOG_BUFFER_SIZE) {
+    structure_log_line& line = logLines[(logHead + logCount) % LOG_BUFFER_SIZE];
+    line.level = level;
+    line.numberAt = numberAt;
+    line.isUnsigned = isUnsigned;
+    line.number = number;
+    appendText(line.text, appendText(line.text, 0, message), message2);
+    logCount++;
+  } else {
+    logDropped++;
+  }
+  portEXIT_CRITICAL(&logLock);
+}
+
+void logLine(int level, const char* message) {
+  queueLine(level, message, nullptr, 0, NUMBER_NONE);
+}
+
+void logLine(int level, int number) {
+  queueLine(level, nullptr, nullptr, number, NUMBER_BEFORE);
+}
+
+void logLine(int level, long number) {
+  queueLine(level, nullptr, nullptr, number, NUMBER_BEFORE);
+}
+
+void logLine(int level, unsigned long number) {
+  queueLine(level, nullptr, nullptr, (long)number, NUMBER_BEFORE, true);
+}
+
+void logLine(int level, const char* message, int number) {
+  queueLine(level, message, nullptr, number, NUMBER_AFTER);
+}
+
+void logLine(int level, const char* message, long number) {
+  queueLine(level, message, nullptr, number, NUMBER_AFTER);
+}
+
+void logLine(int level, const char* message, unsigned long number) {
+  queueLine(level, message, nullptr, (long)number, NUMBER_AFTER, true);
+}
+
+void logLine(int level, int number, const char* message) {
+  queueLine(level, message, nullptr, number, NUMBER_BEFORE);
+}
+
+void logLine(int level, long number, const char* message) {
+  queueLine(level, message, nullptr, number, NUMBER_BEFORE);
+}
+
+void logLine(int level, unsigned long number, const char* message) {
+  queueLine(level, message, nullptr, (long)number, NUMBER_BEFORE, true);
+}
+
+void logLine(int level, const char* message, const char* message2) {
+  queueLine(level, message, message2, 0, NUMBER_NONE);
+}
+
+static void printNumber(const structure_log_line& line) {
+  if (line.isUnsigned) {
+    Serial.print((unsigned long)line.number);
+  } else {
+    Serial.print(line.number);
+  }
+}
+
+// takes one line at a time, so logging is never held up by the Serial writes
+void flushLog() {
+  static unsigned long reportedDropped = 0;
+  structure_log_line line;
+
+  for (;;) {
+    portENTER_CRITICAL(&logLock);
+    const bool hasLine = logCount > 0;
+    if (hasLine) {
+      line = logLines[logHead];
+      logHead = (logHead + 1) % LOG_BUFFER_SIZE;
+      logCount--;
+    }
+    const unsigned long dropped = logDropped;
+    portEXIT_CRITICAL(&logLock);
+
+    if (!hasLine) {
+      if (dropped != reportedDropped) {
+        Serial.print(dropped - reportedDropped);
+        Serial.println(" log lines dropped");
+        reportedDropped = dropped;
+      }
+      return;
+    }
+
+    if (line.numberAt == NUMBER_BEFORE) printNumber(line);
+    Serial.print(line.text);
+    if (line.numberAt == NUMBER_AFTER) printNumber(line);
+    Serial.println();
+  }
+}
+
+unsigned long numOfDroppedLogLines() {
+  portENTER_CRITICAL(&logLock);
+  const unsigned long dropped = logDropped;
+  portEXIT_CRITICAL(&logLock);
+  return dropped;
+}
@@ -0,0 +1,70 @@
+/*
+  AutoCCLog.h
+
+  Andy Valentine - Valentine Autos
+
+  Compile time log levels and a deferred logger. Calls above LOG_LEVEL
+  are removed by the preprocessor, arguments and all. Calls that are
+  kept only copy the line into a ring, and flushLog() does the Serial
+  writes later from the main loop, so the ESP-NOW callbacks and the
+  dispatcher never wait on the UART
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#ifndef AutoCCLog_h
+#define AutoCCLog_h
+
+#include <Arduino.h>
+
+#define LOG_NONE              0
+#define LOG_ERROR             1     // something failed
+#define LOG_INFO              2     // clients coming and going, discovery and commits
+#define LOG_DEBUG             3     // every frame and request
+
+// set with a build flag to override, e.g. -DLOG_LEVEL=LOG_DEBUG
+#ifndef LOG_LEVEL
+#define LOG_LEVEL             LOG_INFO
+#endif
+
+#define LOG_BUFFER_SIZE       64    // lines held until the next flushLog()
+#define LOG_TEXT_SIZE         56    // characters kept of each line, without its number
+
+#if LOG_LEVEL >= LOG_ERROR
+#define logError(...)         logLine(LOG_ERROR, __VA_ARGS__)
+#else
+#define logError(...)         ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_INFO
+#define logInfo(...)          logLine(LOG_INFO, __VA_ARGS__)
+#else
+#define logInfo(...)          ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_DEBUG
+#define logDebug(...)         logLine(LOG_DEBUG, __VA_ARGS__)
+#else
+#define logDebug(...)         ((void)0)
+#endif
+
+// queue a line - use the macros above so disabled levels cost nothing
+// ids are unsigned long and values int, so both have their own overloads
+void logLine(int level, const char* message);
+void logLine(int level, int number);
+void logLine(int level, long number);
+void logLine(int level, unsigned long number);
+void logLine(int level, const char* message, int number);
+void logLine(int level, const char* message, long number);
+void logLine(int level, const char* message, unsigned long number);
+void logLine(int level, int number, const char* message);
+void logLine(int level, long number, const char* message);
+void logLine(int level, unsigned long number, const char* message);
+void logLine(int level, const char* message, const char* message2);
+
+// writes every queued line to Serial - call from loop(), the server's poll() does
+void flushLog();
+unsigned long numOfDroppedLogLines();
+
+#endif
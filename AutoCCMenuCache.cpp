@@ -0,0 +1,85 @@
+/*
+  AutoCCMenuCache.cpp
+
+  Andy Valentine - Valentine Autos
+
+  Flash cache of each client's menu
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include "AutoCCMenuCache.h"
+
+/* A cached menu is one blob per client:
+PROTOCOL_VERSION, fingerprint, count, then count option bodies in client order
+*/
+
+// options cached for the client, 0 if none
+int AutoCCMenuCache::numOfOptions(const byte macAddress[6]) {
+  std::vector<uint8_t> blob;
+  if (!read(macAddress, blob)) return 0;
+
+  AutoCCReader reader(blob.data(), blob.size());
+  reader.getByte();
+  reader.getVarint();
+  const int count = reader.getVarint();
+  return reader.hasFailed() ? 0 : count;
+}
+
+// fills options in client order, only if the cache matches fingerprint and numOfOptions
+bool AutoCCMenuCache::load(const byte macAddress[6], uint32_t fingerprint, int numOfOptions, std::vector<structure_option>& options) {
+  std::vector<uint8_t> blob;
+  if (!read(macAddress, blob)) return false;
+
+  AutoCCReader reader(blob.data(), blob.size());
+  if (reader.getByte() != PROTOCOL_VERSION) return false;
+  if (reader.getVarint() != fingerprint) return false;
+  if ((int)reader.getVarint() != numOfOptions) return false;
+
+  options.resize(numOfOptions);
+  for (int k = 0; k < numOfOptions; k++) {
+    decodeOptionBody(reader, options[k]);
+  }
+  return !reader.hasFailed();
+}
+
+bool AutoCCMenuCache::save(const byte macAddress[6], uint32_t fingerprint, const std::vector<structure_option>& options) {
+  std::vector<uint8_t> blob(1 + 2 * MAX_VARINT_SIZE + options.size() * MAX_OPTION_BODY_SIZE);
+  AutoCCWriter writer(blob.data(), blob.size());
+  writer.putByte(PROTOCOL_VERSION);
+  writer.putVarint(fingerprint);
+  writer.putVarint(options.size());
+  for (const structure_option& option : options) {
+    encodeOptionBody(writer, option);
+  }
+  if (writer.hasOverflowed()) return false;
+
+  char key[MENU_CACHE_KEY_SIZE];
+  makeKey(macAddress, key);
+
+  if (!_preferences.begin(MENU_CACHE_NAMESPACE, false)) {
+    logError("Error opening menu cache");
+    return false;
+  }
+  const bool isSaved = _preferences.putBytes(key, blob.data(), writer.length()) == (size_t)writer.length();
+  _preferences.end();
+  return isSaved;
+}
+
+bool AutoCCMenuCache::read(const byte macAddress[6], std::vector<uint8_t>& blob) {
+  char key[MENU_CACHE_KEY_SIZE];
+  makeKey(macAddress, key);
+
+  if (!_preferences.begin(MENU_CACHE_NAMESPACE, true)) return false;
+  const size_t len = _preferences.isKey(key) ? _preferences.getBytesLength(key) : 0;
+  blob.resize(len);
+  const bool isRead = len > 0 && _preferences.getBytes(key, blob.data(), len) == len;
+  _preferences.end();
+  return isRead;
+}
+
+void AutoCCMenuCache::makeKey(const byte macAddress[6], char key[MENU_CACHE_KEY_SIZE]) {
+  snprintf(key, MENU_CACHE_KEY_SIZE, "m%02x%02x%02x%02x%02x%02x",
+    macAddress[0], macAddress[1], macAddress[2], macAddress[3], macAddress[4], macAddress[5]);
+}
@@ -0,0 +1,36 @@
+/*
+  AutoCCMenuCache.h
+
+  Andy Valentine - Valentine Autos
+
+  Flash cache of each client's menu, used by the server. A menu is saved
+  with the fingerprint of the client's option setup, and only reused
+  while the client still reports the same fingerprint
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#ifndef AutoCCMenuCache_h
+#define AutoCCMenuCache_h
+
+#include <vector>
+#include <Preferences.h>
+#include "AutoCC.h"
+#include "AutoCCCodec.h"
+
+#define MENU_CACHE_NAMESPACE  "autocc_menus"
+#define MENU_CACHE_KEY_SIZE   14    // "m" + 12 hex digits of the MAC + null
+
+class AutoCCMenuCache {
+  public:
+    int numOfOptions(const byte macAddress[6]);
+    bool load(const byte macAddress[6], uint32_t fingerprint, int numOfOptions, std::vector<structure_option>& options);
+    bool save(const byte macAddress[6], uint32_t fingerprint, const std::vector<structure_option>& options);
+  private:
+    Preferences _preferences;
+    bool read(const byte macAddress[6], std::vector<uint8_t>& blob);
+    void makeKey(const byte macAddress[6], char key[MENU_CACHE_KEY_SIZE]);
+};
+
+#endif
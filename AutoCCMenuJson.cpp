@@ -0,0 +1,70 @@
+/*
+  AutoCCMenuJson.cpp
+
+  Andy Valentine - Valentine Autos
+
+  JSON writer for the server's menu
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include "AutoCCMenuJson.h"
+
+// each append returns the new length, or -1 once anything hasn't fit
+static int appendText(char* buffer, int size, int used, const char* text) {
+  if (used < 0) return -1;
+  while (*text != '\0') {
+    if (used >= size) return -1;
+    buffer[used++] = *text++;
+  }
+  return used;
+}
+
+static int appendNumber(char* buffer, int size, int used, long number) {
+  char digits[12];
+  snprintf(digits, sizeof(digits), "%ld", number);
+  return appendText(buffer, size, used, digits);
+}
+
+static int appendUnsigned(char* buffer, int size, int used, unsigned long number) {
+  char digits[12];
+  snprintf(digits, sizeof(digits), "%lu", number);
+  return appendText(buffer, size, used, digits);
+}
+
+// quoted, with quotes, backslashes and control characters escaped
+static int appendString(char* buffer, int size, int used, const char* text, int maxLen) {
+  used = appendText(buffer, size, used, "\"");
+  for (int i = 0; i < maxLen && text[i] != '\0' && used >= 0; i++) {
+    const char c = text[i];
+    if (c == '"' || c == '\\') {
+      const char escaped[3] = {'\\', c, '\0'};
+      used = appendText(buffer, size, used, escaped);
+    } else if ((uint8_t)c < 0x20) {
+      char escaped[7];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", (uint8_t)c);
+      used = appendText(buffer, size, used, escaped);
+    } else {
+      const char plain[2] = {c, '\0'};
+      used = appendText(buffer, size, used, plain);
+    }
+  }
+  return appendText(buffer, size, used, "\"");
+}
+
+int writeMenuItemJson(char* buffer, int size, int used, const structure_option& option) {
+  used = appendText(buffer, size, used, "{\"unique_id\":");
+  used = appendUnsigned(buffer, size, used, option.uniqueId);
+  used = appendText(buffer, size, used, ",\"label\":");
+  used = appendString(buffer, size, used, option.label, sizeof(option.label));
+  used = appendText(buffer, size, used, ",\"type\":");
+  used = appendNumber(buffer, size, used, option.type);
+  used = appendText(buffer, size, used, ",\"rangeMin\":");
+  used = appendNumber(buffer, size, used, option.rangeMin);
+  used = appendText(buffer, size, used, ",\"rangeMax\":");
+  used = appendNumber(buffer, size, used, option.rangeMax);
+  used = appendText(buffer, size, used, ",\"value\":");
+  used = appendNumber(buffer, size, used, option.value);
+  return appendText(buffer, size, used, "}");
+}
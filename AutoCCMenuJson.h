@@ -0,0 +1,30 @@
+/*
+  AutoCCMenuJson.h
+
+  Andy Valentine - Valentine Autos
+
+  Writes the server's menu as JSON in chunks, into a buffer supplied by
+  the caller, so nothing is allocated however big the menu grows
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#ifndef AutoCCMenuJson_h
+#define AutoCCMenuJson_h
+
+#include "AutoCC.h"
+
+#define MENU_JSON_ITEM_SIZE   320   // longest menu item, with every label character escaped
+
+// position in a menu being written in chunks - start from {}
+struct structure_menu_cursor {
+    int nextItem;              // next menu item to write
+    bool isOpen;               // opening bracket written
+    bool isFinished;           // closing bracket written
+};
+
+// appends the item's JSON object at used, returns the new length or -1 if it doesn't fit
+int writeMenuItemJson(char* buffer, int size, int used, const structure_option& option);
+
+#endif
@@ -0,0 +1,142 @@
+/*
+  AutoCCMetrics.h
+
+  Andy Valentine - Valentine Autos
+
+  Counters and round trip histograms fed by the server and the client.
+  Recording is a relaxed atomic add, so it's safe from the ESP-NOW
+  callbacks. Setting METRICS_ENABLED to 0, e.g. with a build flag,
+  leaves every call empty so the module compiles out
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#ifndef AutoCCMetrics_h
+#define AutoCCMetrics_h
+
+#include <Arduino.h>
+#include <atomic>
+
+#ifndef METRICS_ENABLED
+#define METRICS_ENABLED       1
+#endif
+
+#define METRICS_MAX_PEERS     20    // peers tracked, by onlineClients index
+#define METRICS_RTT_BUCKETS   10    // bucket b counts round trips of 2^b to 2^(b+1) ms, the first from 0 and the last upwards
+
+struct structure_peer_metrics {
+    uint32_t numOfReplies;         // requests answered
+    uint32_t numOfTimeouts;        // requests never answered
+    uint32_t numOfRetries;         // requests sent again
+    uint32_t numOfSendFailures;    // frames esp_now failed to send or deliver
+    uint32_t rttTotal;             // ms, summed over every reply
+    uint32_t rttBuckets[METRICS_RTT_BUCKETS]; // replies by round trip, from the first send
+};
+
+struct structure_metrics {
+    structure_peer_metrics peers[METRICS_MAX_PEERS];
+    uint32_t numOfUnknownFrames;   // frames with a flag the receiver doesn't handle
+    uint32_t numOfDuplicates;      // frames dropped as already received
+    uint32_t numOfDroppedFrames;   // frames lost to a full receive queue
+    int queueDepth;                // frames waiting in the receive queue
+    int queueHighWaterMark;        // deepest the receive queue has been
+};
+
+#if METRICS_ENABLED
+
+class AutoCCMetrics {
+  public:
+    // peer is the onlineClients index, anything outside the table is ignored
+    void recordReply(int peer, unsigned long rtt) {
+      if (!isPeer(peer)) return;
+      add(_peers[peer].numOfReplies);
+      add(_peers[peer].rttTotal, rtt);
+      add(_peers[peer].rttBuckets[rttBucket(rtt)]);
+    }
+    void recordTimeout(int peer) {
+      if (isPeer(peer)) add(_peers[peer].numOfTimeouts);
+    }
+    void recordRetry(int peer) {
+      if (isPeer(peer)) add(_peers[peer].numOfRetries);
+    }
+    void recordSendFailure(int peer) {
+      if (isPeer(peer)) add(_peers[peer].numOfSendFailures);
+    }
+    void recordUnknownFrame() {
+      add(_numOfUnknownFrames);
+    }
+
+    // copies every counter, the queue and link fields are left for the owner to fill in
+    void snapshot(structure_metrics& metrics) const {
+      metrics = {};
+      for (int p = 0; p < METRICS_MAX_PEERS; p++) {
+        const structure_atomic_peer& peer = _peers[p];
+        metrics.peers[p].numOfReplies      = peer.numOfReplies.load(std::memory_order_relaxed);
+        metrics.peers[p].numOfTimeouts     = peer.numOfTimeouts.load(std::memory_order_relaxed);
+        metrics.peers[p].numOfRetries      = peer.numOfRetries.load(std::memory_order_relaxed);
+        metrics.peers[p].numOfSendFailures = peer.numOfSendFailures.load(std::memory_order_relaxed);
+        metrics.peers[p].rttTotal          = peer.rttTotal.load(std::memory_order_relaxed);
+        for (int b = 0; b < METRICS_RTT_BUCKETS; b++) {
+          metrics.peers[p].rttBuckets[b] = peer.rttBuckets[b].load(std::memory_order_relaxed);
+        }
+      }
+      metrics.numOfUnknownFrames = _numOfUnknownFrames.load(std::memory_order_relaxed);
+    }
+
+    void reset() {
+      for (structure_atomic_peer& peer : _peers) {
+        peer.numOfReplies = 0;
+        peer.numOfTimeouts = 0;
+        peer.numOfRetries = 0;
+        peer.numOfSendFailures = 0;
+        peer.rttTotal = 0;
+        for (std::atomic<uint32_t>& bucket : peer.rttBuckets) {
+          bucket = 0;
+        }
+      }
+      _numOfUnknownFrames = 0;
+    }
+
+  private:
+    struct structure_atomic_peer {
+        std::atomic<uint32_t> numOfReplies{0};
+        std::atomic<uint32_t> numOfTimeouts{0};
+        std::atomic<uint32_t> numOfRetries{0};
+        std::atomic<uint32_t> numOfSendFailures{0};
+        std::atomic<uint32_t> rttTotal{0};
+        std::atomic<uint32_t> rttBuckets[METRICS_RTT_BUCKETS] = {};
+    };
+    structure_atomic_peer _peers[METRICS_MAX_PEERS];
+    std::atomic<uint32_t> _numOfUnknownFrames{0};
+
+    static bool isPeer(int peer) {
+      return peer >= 0 && peer < METRICS_MAX_PEERS;
+    }
+    static void add(std::atomic<uint32_t>& counter, uint32_t amount = 1) {
+      counter.fetch_add(amount, std::memory_order_relaxed);
+    }
+    // log2 of the round trip, found from the leading zeros
+    static int rttBucket(unsigned long rtt) {
+      const int bucket = (rtt < 2) ? 0 : 31 - __builtin_clz((uint32_t)rtt);
+      return (bucket < METRICS_RTT_BUCKETS) ? bucket : METRICS_RTT_BUCKETS - 1;
+    }
+};
+
+#else
+
+// compiled out - every call is empty and the snapshot is all zeros
+class AutoCCMetrics {
+  public:
+    void recordReply(int, unsigned long) {}
+    void recordTimeout(int) {}
+    void recordRetry(int) {}
+    void recordSendFailure(int) {}
+    void recordUnknownFrame() {}
+    void snapshot(structure_metrics& metrics) const { metrics = {}; }
+    void reset() {}
+};
+
+#endif
+
+#endif
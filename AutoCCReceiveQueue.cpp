@@ -0,0 +1,58 @@
+/*
+  AutoCCReceiveQueue.cpp
+
+  Andy Valentine - Valentine Autos
+
+  Bounded single producer, single consumer ring of received frames
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include "AutoCCReceiveQueue.h"
+
+// false, and counted as dropped, if the queue is full or the frame too long
+bool AutoCCReceiveQueue::push(const uint8_t* macAddress, const uint8_t* data, int len) {
+  const uint32_t tail = _tail.load(std::memory_order_relaxed);
+  const uint32_t head = _head.load(std::memory_order_acquire);
+
+  if (tail - head >= RECEIVE_QUEUE_SIZE || len < 0 || len > MAX_FRAME_SIZE) {
+    _numOfDropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  structure_frame& frame = _frames[tail & (RECEIVE_QUEUE_SIZE - 1)];
+  memcpy(frame.macAddress, macAddress, 6);
+  memcpy(frame.data, data, len);
+  frame.len = len;
+  _tail.store(tail + 1, std::memory_order_release);
+
+  const int depth = tail + 1 - head;
+  if (depth > _highWaterMark.load(std::memory_order_relaxed)) {
+    _highWaterMark.store(depth, std::memory_order_relaxed);
+  }
+  return true;
+}
+
+// oldest frame, or nullptr if empty - stays valid until pop()
+structure_frame* AutoCCReceiveQueue::front() {
+  const uint32_t head = _head.load(std::memory_order_relaxed);
+  if (head == _tail.load(std::memory_order_acquire)) return nullptr;
+  return &_frames[head & (RECEIVE_QUEUE_SIZE - 1)];
+}
+
+void AutoCCReceiveQueue::pop() {
+  _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+int AutoCCReceiveQueue::size() const {
+  return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+}
+
+unsigned long AutoCCReceiveQueue::numOfDropped() const {
+  return _numOfDropped.load(std::memory_order_relaxed);
+}
+
+int AutoCCReceiveQueue::highWaterMark() const {
+  return _highWaterMark.load(std::memory_order_relaxed);
+}
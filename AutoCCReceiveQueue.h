@@ -0,0 +1,55 @@
+/*
+  AutoCCReceiveQueue.h
+
+  Andy Valentine - Valentine Autos
+
+  Bounded single producer, single consumer ring of received frames.
+  The ESP-NOW receive callback only copies frames in, and the client's
+  dispatcher task or the server's loop task drains them, so nothing slow
+  ever runs in the WiFi task
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#ifndef AutoCCReceiveQueue_h
+#define AutoCCReceiveQueue_h
+
+#include <atomic>
+#include "AutoCC.h"
+#include "AutoCCCodec.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#define RECEIVE_QUEUE_SIZE    32    // frames buffered, must be a power of two
+#define DISPATCH_BATCH        8     // frames handled before the dispatcher yields
+#define DISPATCH_STACK_SIZE   4096
+#define DISPATCH_PRIORITY     2     // above the Arduino loop task
+
+struct structure_frame {
+    byte macAddress[6];        // MAC Address of the sender
+    int len;                   // bytes used in data
+    uint8_t data[MAX_FRAME_SIZE];
+};
+
+class AutoCCReceiveQueue {
+  public:
+    // producer side - called from the receive callback only
+    bool push(const uint8_t* macAddress, const uint8_t* data, int len);
+
+    // consumer side - called from the draining task only
+    structure_frame* front();
+    void pop();
+
+    int size() const;
+    unsigned long numOfDropped() const;
+    int highWaterMark() const;
+  private:
+    structure_frame _frames[RECEIVE_QUEUE_SIZE];
+    std::atomic<uint32_t> _head{0};            // next slot to read
+    std::atomic<uint32_t> _tail{0};            // next slot to write
+    std::atomic<unsigned long> _numOfDropped{0};
+    std::atomic<int> _highWaterMark{0};
+};
+
+#endif
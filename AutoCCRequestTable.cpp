@@ -0,0 +1,266 @@
+/*
+  AutoCCRequestTable.cpp
+
+  Andy Valentine - Valentine Autos
+
+  Fixed size table of requests awaiting a reply, keyed by unique id and
+  request type
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include "AutoCCRequestTable.h"
+
+#define REQUEST_TABLE_MASK    (REQUEST_TABLE_SIZE - 1)
+
+AutoCCRequestTable::AutoCCRequestTable() {
+  for (int i = 0; i < REQUEST_TABLE_SIZE; i++) {
+    _isUsed[i] = false;
+  }
+}
+
+// false if the table is full or the id is already waiting on the same request
+bool AutoCCRequestTable::add(const structure_pending_request& pending) {
+  bool added = false;
+  portENTER_CRITICAL(&_lock);
+  if (_count < REQUEST_TABLE_SIZE && findSlot(pending.uniqueId, pending.request) == -1) {
+    int slot = homeSlot(pending.uniqueId);
+    while (_isUsed[slot]) {
+      slot = (slot + 1) & REQUEST_TABLE_MASK;
+    }
+    _entries[slot] = pending;
+    _isUsed[slot] = true;
+    _count++;
+    added = true;
+  }
+  portEXIT_CRITICAL(&_lock);
+  return added;
+}
+
+bool AutoCCRequestTable::contains(unsigned long uniqueId, int request) {
+  portENTER_CRITICAL(&_lock);
+  const bool found = findSlot(uniqueId, request) != -1;
+  portEXIT_CRITICAL(&_lock);
+  return found;
+}
+
+// copies a request without removing it
+bool AutoCCRequestTable::find(unsigned long uniqueId, int request, structure_pending_request& pending) {
+  portENTER_CRITICAL(&_lock);
+  const int slot = findSlot(uniqueId, request);
+  if (slot != -1) {
+    pending = _entries[slot];
+  }
+  portEXIT_CRITICAL(&_lock);
+  return slot != -1;
+}
+
+bool AutoCCRequestTable::remove(unsigned long uniqueId, int request) {
+  portENTER_CRITICAL(&_lock);
+  const int slot = findSlot(uniqueId, request);
+  if (slot != -1) {
+    eraseSlot(slot);
+  }
+  portEXIT_CRITICAL(&_lock);
+  return slot != -1;
+}
+
+// removes a request whether or not it has been answered
+bool AutoCCRequestTable::take(unsigned long uniqueId, int request, structure_pending_request& pending) {
+  portENTER_CRITICAL(&_lock);
+  const int slot = findSlot(uniqueId, request);
+  if (slot != -1) {
+    pending = _entries[slot];
+    eraseSlot(slot);
+  }
+  portEXIT_CRITICAL(&_lock);
+  return slot != -1;
+}
+
+// marks a request answered, handing back a copy with the task to wake
+// false if it isn't waiting or has already been answered
+bool AutoCCRequestTable::complete(unsigned long uniqueId, int request, int value, structure_pending_request& pending) {
+  bool completed = false;
+  portENTER_CRITICAL(&_lock);
+  const int slot = findSlot(uniqueId, request);
+  if (slot != -1 && !_entries[slot].isComplete) {
+    _entries[slot].isComplete = true;
+    _entries[slot].value = value;
+    pending = _entries[slot];
+    completed = true;
+  }
+  portEXIT_CRITICAL(&_lock);
+  return completed;
+}
+
+// removes a request once it has been answered
+bool AutoCCRequestTable::takeCompleted(unsigned long uniqueId, int request, structure_pending_request& pending) {
+  bool taken = false;
+  portENTER_CRITICAL(&_lock);
+  const int slot = findSlot(uniqueId, request);
+  if (slot != -1 && _entries[slot].isComplete) {
+    pending = _entries[slot];
+    eraseSlot(slot);
+    taken = true;
+  }
+  portEXIT_CRITICAL(&_lock);
+  return taken;
+}
+
+// removes an async request that has been answered or has passed its deadline
+bool AutoCCRequestTable::takeFinished(unsigned long now, structure_pending_request& pending) {
+  bool taken = false;
+  portENTER_CRITICAL(&_lock);
+  for (int slot = 0; slot < REQUEST_TABLE_SIZE && _count > 0; slot++) {
+    if (!_isUsed[slot] || !_entries[slot].isAsync) continue;
+    if (_entries[slot].isComplete || (long)(now - _entries[slot].deadline) >= 0) {
+      pending = _entries[slot];
+      eraseSlot(slot);
+      taken = true;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&_lock);
+  return taken;
+}
+
+/* hands back an unanswered request that is due to be sent again, and
+schedules the send after it - false once none are due
+*/
+bool AutoCCRequestTable::takeRetry(unsigned long now, structure_pending_request& pending) {
+  bool taken = false;
+  portENTER_CRITICAL(&_lock);
+  for (int slot = 0; slot < REQUEST_TABLE_SIZE && _count > 0; slot++) {
+    structure_pending_request& entry = _entries[slot];
+    if (!_isUsed[slot] || entry.isComplete || entry.numOfSends >= REQUEST_MAX_SENDS) continue;
+    if ((long)(now - entry.retryAt) >= 0) {
+      entry.numOfSends++;
+      entry.retryAt = now + REQUEST_RETRY_INTERVAL;
+      pending = entry;
+      taken = true;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&_lock);
+  return taken;
+}
+
+// removes any request, answered or not - call until false to empty the table
+bool AutoCCRequestTable::takeNext(structure_pending_request& pending) {
+  bool taken = false;
+  portENTER_CRITICAL(&_lock);
+  for (int slot = 0; slot < REQUEST_TABLE_SIZE && _count > 0; slot++) {
+    if (!_isUsed[slot]) continue;
+    pending = _entries[slot];
+    eraseSlot(slot);
+    taken = true;
+    break;
+  }
+  portEXIT_CRITICAL(&_lock);
+  return taken;
+}
+
+// makes every unanswered request to a client due now, e.g. after a failed send
+// hands back a task waiting on one of them to wake, or nullptr
+TaskHandle_t AutoCCRequestTable::expediteRetries(int clientIndex, unsigned long now) {
+  TaskHandle_t waiter = nullptr;
+  portENTER_CRITICAL(&_lock);
+  for (int slot = 0; slot < REQUEST_TABLE_SIZE; slot++) {
+    structure_pending_request& entry = _entries[slot];
+    if (!_isUsed[slot] || entry.isComplete || entry.clientIndex != clientIndex) continue;
+    if (entry.numOfSends >= REQUEST_MAX_SENDS) continue;
+    entry.retryAt = now;
+    waiter = entry.waiter;
+  }
+  portEXIT_CRITICAL(&_lock);
+  return waiter;
+}
+
+bool AutoCCRequestTable::hasAsync() {
+  bool found = false;
+  portENTER_CRITICAL(&_lock);
+  for (int slot = 0; slot < REQUEST_TABLE_SIZE && !found; slot++) {
+    found = _isUsed[slot] && _entries[slot].isAsync;
+  }
+  portEXIT_CRITICAL(&_lock);
+  return found;
+}
+
+// time until the next async request is due to finish, 0 if one already has
+unsigned long AutoCCRequestTable::timeUntilNextDeadline(unsigned long now, unsigned long maxWait) {
+  unsigned long waitFor = maxWait;
+  portENTER_CRITICAL(&_lock);
+  for (int slot = 0; slot < REQUEST_TABLE_SIZE && waitFor > 0; slot++) {
+    if (!_isUsed[slot] || !_entries[slot].isAsync) continue;
+    if (_entries[slot].isComplete || (long)(now - _entries[slot].deadline) >= 0) {
+      waitFor = 0;
+    } else if (_entries[slot].deadline - now < waitFor) {
+      waitFor = _entries[slot].deadline - now;
+    }
+  }
+  portEXIT_CRITICAL(&_lock);
+  return waitFor;
+}
+
+// time until the next unanswered request is due to be sent again
+unsigned long AutoCCRequestTable::timeUntilNextRetry(unsigned long now, unsigned long maxWait) {
+  unsigned long waitFor = maxWait;
+  portENTER_CRITICAL(&_lock);
+  for (int slot = 0; slot < REQUEST_TABLE_SIZE && waitFor > 0; slot++) {
+    const structure_pending_request& entry = _entries[slot];
+    if (!_isUsed[slot] || entry.isComplete || entry.numOfSends >= REQUEST_MAX_SENDS) continue;
+    if ((long)(now - entry.retryAt) >= 0) {
+      waitFor = 0;
+    } else if (entry.retryAt - now < waitFor) {
+      waitFor = entry.retryAt - now;
+    }
+  }
+  portEXIT_CRITICAL(&_lock);
+  return waitFor;
+}
+
+int AutoCCRequestTable::count() {
+  portENTER_CRITICAL(&_lock);
+  const int numOfRequests = _count;
+  portEXIT_CRITICAL(&_lock);
+  return numOfRequests;
+}
+
+
+
+/* SLOT MANAGEMENT - lock must be held */
+
+// fibonacci hashing spreads the mostly sequential ids across the table
+int AutoCCRequestTable::homeSlot(unsigned long uniqueId) const {
+  return ((uint32_t)uniqueId * 2654435769u) >> (32 - REQUEST_TABLE_BITS);
+}
+
+// requests sharing an id share a home slot, so they sit in the same probe run
+int AutoCCRequestTable::findSlot(unsigned long uniqueId, int request) const {
+  int slot = homeSlot(uniqueId);
+  for (int probes = 0; probes < REQUEST_TABLE_SIZE && _isUsed[slot]; probes++) {
+    if (_entries[slot].uniqueId == uniqueId && _entries[slot].request == request) return slot;
+    slot = (slot + 1) & REQUEST_TABLE_MASK;
+  }
+  return -1;
+}
+
+// backward shift deletion - later entries in the probe run move up into
+// the hole, so no tombstones build up and probe runs stay short
+void AutoCCRequestTable::eraseSlot(int slot) {
+  int hole = slot;
+  int next = slot;
+  for (int probes = 1; probes < REQUEST_TABLE_SIZE; probes++) {
+    next = (next + 1) & REQUEST_TABLE_MASK;
+    if (!_isUsed[next]) break;
+
+    const int home = homeSlot(_entries[next].uniqueId);
+    if (((next - home) & REQUEST_TABLE_MASK) >= ((next - hole) & REQUEST_TABLE_MASK)) {
+      _entries[hole] = _entries[next];
+      hole = next;
+    }
+  }
+  _isUsed[hole] = false;
+  _count--;
+}
@@ -0,0 +1,78 @@
+/*
+  AutoCCRequestTable.h
+
+  Andy Valentine - Valentine Autos
+
+  Fixed size table of requests awaiting a reply, keyed by unique id and
+  request type, as an item's id is reused by requests of different types.
+  Open addressed with linear probing, so lookups are constant time and
+  nothing is allocated once the server is constructed. Every call takes
+  a spinlock, as the table is shared between the ESP-NOW receive path
+  and the task making requests
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#ifndef AutoCCRequestTable_h
+#define AutoCCRequestTable_h
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#define REQUEST_TABLE_BITS    6                         // 64 requests in flight at most
+#define REQUEST_TABLE_SIZE    (1 << REQUEST_TABLE_BITS)
+#define REQUEST_RETRY_INTERVAL 50                       // ms without a reply before a request is sent again
+#define REQUEST_MAX_SENDS     10                        // sends of a request, spread across the whole 500 ms REQUEST_TIMEOUT
+
+// fired from poll() once an async request is answered or times out
+typedef void (*AutoCCCallback)(unsigned long uniqueId, bool success, int value);
+
+struct structure_pending_request {
+    unsigned long uniqueId;   // unique id of the request awaiting a reply
+    TaskHandle_t waiter;       // task woken when the reply arrives
+    int request;               // REQUEST_XXX sent
+    int clientIndex;           // index in onlineClients
+    int sentValue;             // value sent with the request, kept to send it again
+    uint16_t seq;              // link sequence number, reused when sent again
+    int numOfSends;            // times the request has been sent
+    unsigned long retryAt;     // millis() after which it's sent again if still unanswered
+    unsigned long sentAt;      // millis() of the first send, for round trip times
+    int value;                 // value of the reply
+    bool isComplete;           // reply received
+    bool isAsync;              // finished by poll() rather than a blocking wait
+    unsigned long deadline;    // millis() after which the request times out
+    AutoCCCallback callback;   // optional, fired from poll()
+};
+
+class AutoCCRequestTable {
+  public:
+    AutoCCRequestTable();
+    bool add(const structure_pending_request& pending);
+    bool contains(unsigned long uniqueId, int request);
+    bool find(unsigned long uniqueId, int request, structure_pending_request& pending);
+    bool remove(unsigned long uniqueId, int request);
+    bool take(unsigned long uniqueId, int request, structure_pending_request& pending);
+    bool complete(unsigned long uniqueId, int request, int value, structure_pending_request& pending);
+    bool takeCompleted(unsigned long uniqueId, int request, structure_pending_request& pending);
+    bool takeFinished(unsigned long now, structure_pending_request& pending);
+    bool takeRetry(unsigned long now, structure_pending_request& pending);
+    bool takeNext(structure_pending_request& pending);
+    TaskHandle_t expediteRetries(int clientIndex, unsigned long now);
+    bool hasAsync();
+    unsigned long timeUntilNextDeadline(unsigned long now, unsigned long maxWait);
+    unsigned long timeUntilNextRetry(unsigned long now, unsigned long maxWait);
+    int count();
+  private:
+    structure_pending_request _entries[REQUEST_TABLE_SIZE];
+    bool _isUsed[REQUEST_TABLE_SIZE];
+    int _count = 0;
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+
+    int homeSlot(unsigned long uniqueId) const;
+    int findSlot(unsigned long uniqueId, int request) const;
+    void eraseSlot(int slot);
+};
+
+#endif
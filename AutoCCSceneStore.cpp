@@ -0,0 +1,82 @@
+/*
+  AutoCCSceneStore.cpp
+
+  Andy Valentine - Valentine Autos
+
+  Flash storage of saved scenes
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include "AutoCCSceneStore.h"
+
+/* A scene is one blob keyed by its name:
+count, then count entries of macAddress, memId and value
+*/
+
+bool AutoCCSceneStore::save(const char* name, const std::vector<structure_scene_entry>& entries) {
+  if (!isValidName(name)) return false;
+
+  std::vector<uint8_t> blob(MAX_VARINT_SIZE + entries.size() * SCENE_ENTRY_SIZE);
+  AutoCCWriter writer(blob.data(), blob.size());
+  writer.putVarint(entries.size());
+  for (const structure_scene_entry& entry : entries) {
+    for (int b = 0; b < 6; b++) {
+      writer.putByte(entry.macAddress[b]);
+    }
+    writer.putString(entry.memId, sizeof(entry.memId));
+    writer.putSigned(entry.value);
+  }
+  if (writer.hasOverflowed()) return false;
+
+  if (!_preferences.begin(SCENE_NAMESPACE, false)) {
+    logError("Error opening scene store");
+    return false;
+  }
+  const bool isSaved = _preferences.putBytes(name, blob.data(), writer.length()) == (size_t)writer.length();
+  _preferences.end();
+  return isSaved;
+}
+
+bool AutoCCSceneStore::load(const char* name, std::vector<structure_scene_entry>& entries) {
+  if (!isValidName(name)) return false;
+  if (!_preferences.begin(SCENE_NAMESPACE, true)) return false;
+
+  const size_t len = _preferences.isKey(name) ? _preferences.getBytesLength(name) : 0;
+  std::vector<uint8_t> blob(len);
+  const bool isRead = len > 0 && _preferences.getBytes(name, blob.data(), len) == len;
+  _preferences.end();
+  if (!isRead) return false;
+
+  AutoCCReader reader(blob.data(), len);
+  const uint32_t count = reader.getVarint();
+  if (count > len / 8) return false; // every entry takes at least 8 bytes
+  entries.resize(count);
+  for (structure_scene_entry& entry : entries) {
+    for (int b = 0; b < 6; b++) {
+      entry.macAddress[b] = reader.getByte();
+    }
+    reader.getString(entry.memId, sizeof(entry.memId));
+    entry.value = reader.getSigned();
+  }
+  return !reader.hasFailed();
+}
+
+bool AutoCCSceneStore::remove(const char* name) {
+  if (!isValidName(name)) return false;
+  if (!_preferences.begin(SCENE_NAMESPACE, false)) return false;
+
+  const bool isRemoved = _preferences.remove(name);
+  _preferences.end();
+  return isRemoved;
+}
+
+bool AutoCCSceneStore::isValidName(const char* name) {
+  const size_t len = strnlen(name, SCENE_NAME_SIZE);
+  if (len == 0 || len >= SCENE_NAME_SIZE) {
+    logError("Scene names must be 1 to 15 characters");
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,42 @@
+/*
+  AutoCCSceneStore.h
+
+  Andy Valentine - Valentine Autos
+
+  Flash storage of saved scenes, used by the server. Unique ids change
+  every time a client is discovered, so scene entries are stored against
+  the client's MAC address and the option's memId instead
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#ifndef AutoCCSceneStore_h
+#define AutoCCSceneStore_h
+
+#include <vector>
+#include <Preferences.h>
+#include "AutoCC.h"
+#include "AutoCCCodec.h"
+
+#define SCENE_NAMESPACE       "autocc_scenes"
+#define SCENE_NAME_SIZE       16    // NVS keys are 15 characters at most
+#define SCENE_ENTRY_SIZE      (6 + 1 + 13 + MAX_VARINT_SIZE) // encoded size of a full entry
+
+struct structure_scene_entry {
+    byte macAddress[6];        // client owning the option
+    char memId[13];            // MEM id of the option
+    int value;                 // value the scene sets
+};
+
+class AutoCCSceneStore {
+  public:
+    bool save(const char* name, const std::vector<structure_scene_entry>& entries);
+    bool load(const char* name, std::vector<structure_scene_entry>& entries);
+    bool remove(const char* name);
+  private:
+    Preferences _preferences;
+    bool isValidName(const char* name);
+};
+
+#endif
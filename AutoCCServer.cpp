@@ -37,97 +37,146 @@ bool AutoCCServer::begin(structure_peer* clients, int numOfClients) {
   if (initESPNOW()) {
     registerCallbacks();
     if (registerAllPeers(clients)) {
-      print("All clients online");
+      logInfo("All clients online");
       return true;
     }
   }
   return false;
 }
 
-bool AutoCCServer::registerAllPeers(structure_peer* clients) {
-  if (_numOfClients == 0) return false;
+/* Same as begin, but returns straight away
+Clients are probed and their options downloaded in the background by poll()
+*/
+bool AutoCCServer::beginAsync(structure_peer* clients, int numOfClients) {
+  _numOfClients = numOfClients;
 
-  numOfOnlineClients = _numOfClients;
+  connectToWifi(DEVICE_SERVER);
+  if (!initESPNOW()) return false;
 
+  registerCallbacks();
   for (int i = 0; i < _numOfClients; i++) {
-    if (registerPeer(clients[i])) {
-      const unsigned long uniqueId = generateUniqueId();
-
-      structure_online_client onlineClient;
-      strcpy(onlineClient.label, clients[i].label);
-      memcpy(onlineClient.macAddress, clients[i].macAddress, 6 * sizeof(byte));
-      onlineClient.numOfOptions = 0;
-      onlineClient.isOnline = OFFLINE;
-      onlineClient.uniqueId = uniqueId;
-    
-      onlineClients.push_back(onlineClient);
-
-      if (testAwake(clients[i].macAddress)) {
-        onlineClients[i].isOnline = ONLINE;
-        allocateId(clients[i].macAddress, uniqueId);
-        getAllOptions(i);
-      }
-    }; 
-
-    // after testing final client
-    if (i == (_numOfClients - 1)) {
-      print(numOfOnlineClients, " clients registered");
-      return true;
+    if (addClient(clients[i])) {
+      numOfOnlineClients++;
     }
   }
+  logInfo(numOfOnlineClients, " clients registered");
 
-  return false;
+  return checkAwakeStatusAsync();
 }
 
-bool AutoCCServer::getAllOptions(int i) { 
-  _numOfOptionsToGet = 0;
-  const unsigned long uniqueId = generateUniqueId();
-
-  if (sendRequest(onlineClients[i].macAddress, uniqueId, REQUEST_COUNT, 0)) {
-    if (startTimeout(uniqueId)) {
-      print(_numOfOptionsToGet, " options to get");
-      onlineClients[i].numOfOptions = _numOfOptionsToGet;
-      for (int j = 0; j < _numOfOptionsToGet; j++) {
-        const unsigned long uniqueId2 = generateUniqueId();
-        if (sendRequest(onlineClients[i].macAddress, uniqueId2, REQUEST_OPTION, j)) {
-          if (startTimeout(uniqueId2)) {
-            numOfMenuItems++;
-            print("Successfully requested option ", j);
-          }
-        }
+bool AutoCCServer::registerAllPeers(structure_peer* clients) {
+  if (_numOfClients == 0) return false;
 
-        if ((i == (numOfOnlineClients - 1)) && (j == (_numOfOptionsToGet - 1))) {
-          return true;
-        }
-      }
-    } else {
-      // retry?
+  for (int i = 0; i < _numOfClients; i++) {
+    if (addClient(clients[i])) {
+      numOfOnlineClients++;
     }
   }
+  logInfo(numOfOnlineClients, " clients registered");
 
-  return false; // bool catch
+  return checkAwakeStatus();
 }
 
-bool AutoCCServer::testAwake(byte macAddress[6]) {
-    const unsigned long uniqueId = generateUniqueId();
-
-  if (sendRequest(macAddress, uniqueId, REQUEST_AWAKE, 0)) {
-    return startTimeout(uniqueId);
-  };
+bool AutoCCServer::addClient(structure_peer client) {
+  if (!registerPeer(client)) return false;
+
+  structure_online_client onlineClient;
+  strcpy(onlineClient.label, client.label);
+  memcpy(onlineClient.macAddress, client.macAddress, 6 * sizeof(byte));
+  onlineClient.numOfOptions = 0;
+  onlineClient.isOnline = OFFLINE;
+  onlineClient.uniqueId = generateUniqueId();
+  onlineClient.lastSeen = 0;
+  onlineClient.nextProbe = 0;
+  onlineClient.probeBackoff = PROBE_BACKOFF_MIN;
+  onlineClient.isProbing = false;
+  onlineClient.hasAnnounced = false;
+
+  onlineClients.push_back(onlineClient);
+  _discoveries.push_back({});
+
+  portENTER_CRITICAL(&_peerLock);
+  if (_numOfPeerMacs < LINK_MAX_PEERS) {
+    memcpy(_peerMacs[_numOfPeerMacs++], client.macAddress, 6);
+  }
+  portEXIT_CRITICAL(&_peerLock);
+  return true;
 }
 
-bool AutoCCServer::allocateId(byte macAddress[6], unsigned long uniqueId) {
-  print("Id allocated to server: ", uniqueId);
-  if (sendRequest(macAddress, uniqueId, REQUEST_ALLOCATE_ID, 0)) {
-    return startTimeout(uniqueId);
-  };
+/* Probes every client at once and collects the replies against one shared
+deadline, so a sweep costs a single REQUEST_TIMEOUT however many are offline
+*/
+std::vector<bool> AutoCCServer::probeAllClients() {
+  std::vector<unsigned long> probeIds(numOfOnlineClients);
+  std::vector<bool> isWaiting(numOfOnlineClients, false);
+  std::vector<bool> isOnline(numOfOnlineClients, false);
+  int numOfWaiting = 0;
+
+  for (int i = 0; i < numOfOnlineClients; i++) {
+    probeIds[i] = generateUniqueId();
+    if (!sendListed(probeIds[i], REQUEST_AWAKE, i, 0, nullptr, false)) continue;
+    isWaiting[i] = true;
+    numOfWaiting++;
+  }
+
+  const unsigned long startTime = millis();
+  structure_pending_request pending;
+  while (numOfWaiting > 0) {
+    for (int i = 0; i < numOfOnlineClients; i++) {
+      if (isWaiting[i] && requestList.takeCompleted(probeIds[i], REQUEST_AWAKE, pending)) {
+        isWaiting[i] = false;
+        isOnline[i] = true;
+        numOfWaiting--;
+      }
+    }
+
+    const unsigned long elapsed = millis() - startTime;
+    if (numOfWaiting == 0 || elapsed >= REQUEST_TIMEOUT) break;
+    retryRequests();
+    waitForReply(std::min(REQUEST_TIMEOUT - elapsed, timeUntilNextDeadline()));
+  }
+
+  // anything left never answered
+  for (int i = 0; i < numOfOnlineClients; i++) {
+    if (isWaiting[i]) {
+      removeFromRequestList(probeIds[i], REQUEST_AWAKE);
+    }
+  }
+
+  return isOnline;
 }
 
 
 // public function to set all clients to new list
 // potential "restart" button in ui
 void AutoCCServer::resetClients(structure_peer* clients) {
+  // requests in flight and menu owners hold indexes into the old list, so
+  // they go with it, and async callbacks fire as failed
+  structure_pending_request pending;
+  while (requestList.takeNext(pending)) {
+    if (pending.callback != nullptr) {
+      pending.callback(pending.uniqueId, false, pending.value);
+    }
+  }
+  _packedRequests.clear();
+
+  for (const structure_option& item : menuItems) {
+    if (item.type == TYPE_TELEMETRY) {
+      telemetry.removeChannel(item.uniqueId);
+    }
+  }
+  menuItems.clear();
+  _menuIndex.clear();
+  _menuOwners.clear();
+  numOfMenuItems = 0;
+  _changeLog.invalidate();
+  metrics.reset();
+
+  portENTER_CRITICAL(&_peerLock);
+  _numOfPeerMacs = 0;
+  portEXIT_CRITICAL(&_peerLock);
   onlineClients.clear();
+  _discoveries.clear();
   numOfOnlineClients = 0;
   registerAllPeers(clients);
 }
@@ -136,87 +185,909 @@ void AutoCCServer::resetClients(structure_peer* clients) {
 
 /* SETTING NEW VALUES */
 bool AutoCCServer::setValue(unsigned long uniqueId, int newValue) {
-  int optionIndex = findOptionFromUniqueId(menuItems, numOfMenuItems, uniqueId);
+  int optionIndex = findMenuItem(uniqueId);
 
   if (optionIndex > -1) {
+    if (_menuOwners[optionIndex] < 0) {
+      logInfo(uniqueId, " has no known owner");
+      return false;
+    }
     if (isValidValue(menuItems[optionIndex], newValue)) {
-      if (sendUpdateRequest(uniqueId, newValue)) {
-        print("New value successfully set");
+      if (sendUpdateRequest(optionIndex, newValue)) {
+        logDebug("New value successfully set");
         return true;
       } else {
-        print("Error setting new value");
+        logError("Error setting new value");
         return false;  
       };
     } else {
-      print("Invalid value sent");
+      logDebug("Invalid value sent");
       return false;
     }
   } else {
-    print("Unique ID not found");
+    logDebug("Unique ID not found");
     return false;
   }
 }
 
+/* Same checks as setValue, but returns straight away
+callback fires from poll() once the owning client confirms, or on timeout
+A value still in flight for the item is superseded, and its callback
+fires here - with success false unless its reply had already arrived
+Returns the uniqueId as a handle, or 0 if the value can't be sent
+*/
+unsigned long AutoCCServer::setValueAsync(unsigned long uniqueId, int newValue, AutoCCCallback callback) {
+  int optionIndex = findMenuItem(uniqueId);
 
-bool AutoCCServer::sendUpdateRequest(unsigned long uniqueId, int newValue) {
-  for (int i = 0; i < numOfOnlineClients; i++) {
-    sendRequest(onlineClients[i].macAddress, uniqueId, REQUEST_SET_VALUE, newValue);
+  if (optionIndex < 0) {
+    logDebug("Unique ID not found");
+    return 0;
+  }
+  if (!isValidValue(menuItems[optionIndex], newValue)) {
+    logDebug("Invalid value sent");
+    return 0;
+  }
+  if (_menuOwners[optionIndex] < 0) {
+    logInfo(uniqueId, " has no known owner");
+    return 0;
+  }
+
+  // a newer value supersedes one still in flight
+  structure_pending_request superseded;
+  if (requestList.take(uniqueId, REQUEST_SET_VALUE, superseded)) {
+    logDebug(uniqueId, " superseded");
+    handleAsyncResult(superseded);
+  }
+
+  if (!sendListed(uniqueId, REQUEST_SET_VALUE, _menuOwners[optionIndex], newValue, callback)) return 0;
+  return uniqueId;
+}
+
+/* Sets many values at once. Updates are grouped by the client owning
+them, and each client is sent one FLAG_SET_VALUES frame per
+SET_VALUES_MAX updates, all in flight together. Each frame's reply is a
+bitmask of the pairs the client applied, which fills in isSet.
+Returns the number of values set
+*/
+int AutoCCServer::setValues(structure_value_update* updates, int numOfUpdates) {
+  _packedRequests.clear();
+  packValues(updates, numOfUpdates);
+
+  std::vector<bool> isWaiting(_packedRequests.size(), false);
+  int numOfWaiting = 0;
+  for (size_t r = 0; r < _packedRequests.size(); r++) {
+    isWaiting[r] = sendListed(_packedRequests[r].uniqueId, REQUEST_SET_VALUES, _packedRequests[r].clientIndex, 0, nullptr, false);
+    if (isWaiting[r]) numOfWaiting++;
   }
-  if (startTimeout(uniqueId)) {
-    print("Options changed successfully");
+
+  const unsigned long startTime = millis();
+  structure_pending_request pending;
+  while (numOfWaiting > 0) {
+    for (size_t r = 0; r < _packedRequests.size(); r++) {
+      if (!isWaiting[r] || !requestList.takeCompleted(_packedRequests[r].uniqueId, REQUEST_SET_VALUES, pending)) continue;
+      isWaiting[r] = false;
+      numOfWaiting--;
+
+      const std::vector<int>& items = _packedRequests[r].items;
+      for (size_t k = 0; k < items.size(); k++) {
+        updates[items[k]].isSet = (pending.value >> k) & 1;
+      }
+    }
+
+    const unsigned long elapsed = millis() - startTime;
+    if (numOfWaiting == 0 || elapsed >= REQUEST_TIMEOUT) break;
+    retryRequests();
+    waitForReply(std::min(REQUEST_TIMEOUT - elapsed, timeUntilNextDeadline()));
+  }
+
+  // anything left never answered
+  for (size_t r = 0; r < _packedRequests.size(); r++) {
+    if (isWaiting[r]) {
+      removeFromRequestList(_packedRequests[r].uniqueId, REQUEST_SET_VALUES);
+    }
+  }
+  _packedRequests.clear();
+
+  int numOfSet = 0;
+  for (int u = 0; u < numOfUpdates; u++) {
+    if (updates[u].isSet) {
+      updateValue(updates[u].uniqueId, updates[u].value);
+      numOfSet++;
+    }
+  }
+  logInfo(numOfSet, " values set");
+  return numOfSet;
+}
+
+// builds the FLAG_SET_VALUES frames for setValues, skipping anything invalid
+void AutoCCServer::packValues(structure_value_update* updates, int numOfUpdates) {
+  std::vector<int> openRequest(numOfOnlineClients, -1); // request each client's next pair goes in
+
+  for (int u = 0; u < numOfUpdates; u++) {
+    updates[u].isSet = false;
+
+    const int slot = findMenuItem(updates[u].uniqueId);
+    if (slot < 0 || !isValidValue(menuItems[slot], updates[u].value)) {
+      logInfo(updates[u].uniqueId, " is not a valid update");
+      continue;
+    }
+    const int owner = _menuOwners[slot];
+    if (owner < 0 || owner >= numOfOnlineClients) {
+      logInfo(updates[u].uniqueId, " has no known owner");
+      continue;
+    }
+
+    int r = openRequest[owner];
+    if (r < 0 || _packedRequests[r].items.size() >= SET_VALUES_MAX) {
+      r = _packedRequests.size();
+      openRequest[owner] = r;
+      _packedRequests.push_back({});
+      _packedRequests[r].uniqueId = generateUniqueId();
+      _packedRequests[r].clientIndex = owner;
+    }
+    _packedRequests[r].items.push_back(u);
+  }
+
+  for (structure_packed_request& packed : _packedRequests) {
+    structure_option_batch batch;
+    batch.count       = packed.items.size();
+    batch.startIndex  = 0;
+    batch.uniqueId    = packed.uniqueId;
+    batch.clientId    = onlineClients[packed.clientIndex].uniqueId;
+
+    AutoCCWriter writer(packed.frame, sizeof(packed.frame));
+    encodeBatchHeader(writer, batch, FLAG_SET_VALUES);
+    for (int u : packed.items) {
+      writer.putVarint(updates[u].uniqueId);
+      writer.putSigned(updates[u].value);
+    }
+    packed.len = writer.length();
+  }
+}
+
+bool AutoCCServer::sendUpdateRequest(int optionIndex, int newValue) {
+  const unsigned long uniqueId = menuItems[optionIndex].uniqueId;
+
+  if (!sendListed(uniqueId, REQUEST_SET_VALUE, _menuOwners[optionIndex], newValue, nullptr, false)) return false;
+  if (startTimeout(uniqueId, REQUEST_SET_VALUE)) {
+    logInfo("Options changed successfully");
     return true;
   }
   return false;
 }
 
+
+/* adds to the menu, noting which client owns the item and indexing its uniqueId
+Returns false, leaving the menu as it was, if the uniqueId is already there
+*/
+bool AutoCCServer::addMenuItem(const structure_option& option) {
+  const structure_menu_index entry = {option.uniqueId, (int)menuItems.size()};
+  auto it = std::lower_bound(_menuIndex.begin(), _menuIndex.end(), entry, [](const structure_menu_index& a, const structure_menu_index& b) {
+    return a.uniqueId < b.uniqueId;
+  });
+  if (it != _menuIndex.end() && it->uniqueId == option.uniqueId) {
+    logDebug(option.uniqueId, " is already in the menu");
+    return false;
+  }
+
+  _menuIndex.insert(it, entry); // ids mostly arrive in order, so this is normally an append
+  menuItems.push_back(option);
+  _menuOwners.push_back(findClientFromUniqueId(option.clientId));
+  numOfMenuItems++;
+  _changeLog.invalidate();
+
+  if (option.type == TYPE_TELEMETRY && !telemetry.addChannel(option.uniqueId)) {
+    logError(option.label, " has no telemetry channel left, only its latest value is kept");
+  }
+  return true;
+}
+
+// index in menuItems of the item with uniqueId, -1 if not found
+int AutoCCServer::findMenuItem(unsigned long uniqueId) {
+  auto it = std::lower_bound(_menuIndex.begin(), _menuIndex.end(), uniqueId, [](const structure_menu_index& entry, unsigned long id) {
+    return entry.uniqueId < id;
+  });
+  if (it == _menuIndex.end() || it->uniqueId != uniqueId) return -1;
+  return it->slot;
+}
+
+// drops every menu item owned by the client, before its changed menu is downloaded again
+void AutoCCServer::removeClientMenu(int i) {
+  std::vector<int> keptSlot(menuItems.size(), -1); // new slot of each item, -1 if dropped
+  int numOfKept = 0;
+  for (int slot = 0; slot < (int)menuItems.size(); slot++) {
+    if (_menuOwners[slot] == i) {
+      if (menuItems[slot].type == TYPE_TELEMETRY) {
+        telemetry.removeChannel(menuItems[slot].uniqueId);
+      }
+      continue;
+    }
+    menuItems[numOfKept] = menuItems[slot];
+    _menuOwners[numOfKept] = _menuOwners[slot];
+    keptSlot[slot] = numOfKept++;
+  }
+  menuItems.resize(numOfKept);
+  _menuOwners.resize(numOfKept);
+  numOfMenuItems = numOfKept;
+  _changeLog.invalidate();
+
+  // dropping entries keeps the index sorted, so it only needs its slots moving
+  int numOfIndexed = 0;
+  for (const structure_menu_index& entry : _menuIndex) {
+    if (keptSlot[entry.slot] < 0) continue;
+    _menuIndex[numOfIndexed++] = {entry.uniqueId, keptSlot[entry.slot]};
+  }
+  _menuIndex.resize(numOfIndexed);
+}
+
+// index in menuItems of the option memId owned by the client, -1 if not found
+int AutoCCServer::findMenuItemOf(int clientIndex, const char* memId) {
+  for (int slot = 0; slot < (int)menuItems.size(); slot++) {
+    if (_menuOwners[slot] == clientIndex && strcmp(menuItems[slot].memId, memId) == 0) {
+      return slot;
+    }
+  }
+  return -1;
+}
+
+// index in onlineClients of the client given clientId, -1 if not found
+int AutoCCServer::findClientFromUniqueId(unsigned long clientId) {
+  for (int i = 0; i < numOfOnlineClients; i++) {
+    if (onlineClients[i].uniqueId == clientId) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// index in onlineClients of the client with macAddress, -1 if not found
+int AutoCCServer::findClientFromMac(const byte macAddress[6]) {
+  for (int i = 0; i < numOfOnlineClients; i++) {
+    if (memcmp(onlineClients[i].macAddress, macAddress, 6) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
 void AutoCCServer::updateValue(unsigned long uniqueId, int newValue) {
-  int optionIndex = findOptionFromUniqueId(menuItems, numOfMenuItems, uniqueId);
+  int optionIndex = findMenuItem(uniqueId);
+  if (optionIndex < 0) return;
+  if (menuItems[optionIndex].value == newValue) return;
   menuItems[optionIndex].value = newValue;
+  _changeLog.add(uniqueId, newValue, CHANGE_VALUE);
+}
+
+
+
+
+/* MENU SERIALISATION */
+
+/* Writes as many whole items as fit in buffer, carrying on from cursor.
+Call until it returns 0, passing the same cursor - buffer must hold at
+least MENU_JSON_ITEM_SIZE, and -1 is returned if it doesn't
+*/
+int AutoCCServer::writeMenuJson(char* buffer, int size, structure_menu_cursor& cursor) {
+  if (cursor.isFinished) return 0;
+  if (size < MENU_JSON_ITEM_SIZE) return -1;
+
+  int used = 0;
+  if (!cursor.isOpen) {
+    buffer[used++] = '[';
+    cursor.isOpen = true;
+  }
+
+  while (cursor.nextItem < numOfMenuItems) {
+    const int start = used;
+    if (cursor.nextItem > 0) {
+      if (used >= size) break;
+      buffer[used++] = ',';
+    }
+    used = writeMenuItemJson(buffer, size, used, menuItems[cursor.nextItem]);
+    if (used < 0) {
+      used = start; // full, the item goes in the next chunk
+      break;
+    }
+    cursor.nextItem++;
+  }
+
+  if (cursor.nextItem >= numOfMenuItems && used < size) {
+    buffer[used++] = ']';
+    cursor.isFinished = true;
+  }
+  return used;
+}
+
+// the whole menu to a stream, through a chunk on the stack
+size_t AutoCCServer::writeMenuJson(Print& out) {
+  char chunk[MENU_JSON_ITEM_SIZE * 2];
+  structure_menu_cursor cursor = {};
+  size_t written = 0;
+  int len;
+  while ((len = writeMenuJson(chunk, sizeof(chunk), cursor)) > 0) {
+    written += out.write((const uint8_t*)chunk, len);
+  }
+  return written;
+}
+
+// changes whenever an item is added or removed, a value changes or a client comes or goes, e.g. for an ETag
+unsigned long AutoCCServer::menuVersion() {
+  return _changeLog.sequence();
+}
+
+/* copies up to maxChanges changes after seq, a menuVersion() the caller
+has already seen, oldest first. Returns the number copied, or -1 once
+they are no longer held, when the whole menu has to be fetched again
+*/
+int AutoCCServer::changesSince(unsigned long seq, structure_change* changes, int maxChanges) {
+  return _changeLog.since(seq, changes, maxChanges);
 }
 
 
 
+/* SCENES */
+
+// saves the updates under name, replacing any scene already saved with it
+bool AutoCCServer::saveScene(const char* name, const structure_value_update* updates, int numOfUpdates) {
+  std::vector<structure_scene_entry> entries;
+  for (int u = 0; u < numOfUpdates; u++) {
+    const int slot = findMenuItem(updates[u].uniqueId);
+    const int owner = (slot < 0) ? -1 : _menuOwners[slot];
+    if (owner < 0 || owner >= numOfOnlineClients) {
+      logInfo(updates[u].uniqueId, " can't be saved in a scene");
+      return false;
+    }
+
+    structure_scene_entry entry;
+    memcpy(entry.macAddress, onlineClients[owner].macAddress, 6);
+    strcpy(entry.memId, menuItems[slot].memId);
+    entry.value = updates[u].value;
+    entries.push_back(entry);
+  }
+  return _sceneStore.save(name, entries);
+}
+
+// returns the number of values set, -1 if there's no scene saved as name
+int AutoCCServer::applyScene(const char* name) {
+  std::vector<structure_scene_entry> entries;
+  if (!_sceneStore.load(name, entries)) {
+    logInfo(name, " is not a saved scene");
+    return -1;
+  }
+
+  std::vector<structure_value_update> updates;
+  for (const structure_scene_entry& entry : entries) {
+    const int i = findClientFromMac(entry.macAddress);
+    const int slot = (i < 0) ? -1 : findMenuItemOf(i, entry.memId);
+    if (slot < 0) {
+      logInfo(entry.memId, " from the scene is not in the menu");
+      continue;
+    }
+    updates.push_back({menuItems[slot].uniqueId, entry.value, false});
+  }
+  return setValues(updates.data(), updates.size());
+}
+
+bool AutoCCServer::removeScene(const char* name) {
+  return _sceneStore.remove(name);
+}
+
+
+
+/* ASYNC REQUESTS AND DISCOVERY */
+
+/* Async requests sit in the requestList until their reply arrives or they
+time out, and poll() then finishes them on the caller's task. Option
+discovery runs as a chain of these, one step per reply:
+REQUEST_ALLOCATE_ID -> REQUEST_COUNT -> REQUEST_OPTION_BATCH / REQUEST_OPTION
+or, when the count comes with the fingerprint of a cached menu:
+REQUEST_ALLOCATE_ID -> REQUEST_COUNT -> REQUEST_VALUE_BATCH
+*/
+
+void AutoCCServer::poll() {
+  handleReceived();
+  retryRequests();
+
+  structure_pending_request pending;
+  while (requestList.takeFinished(millis(), pending)) {
+    if (!pending.isComplete) {
+      metrics.recordTimeout(pending.clientIndex);
+    }
+    handleAsyncResult(pending);
+  }
+
+  checkAnnouncements();
+  checkLiveness();
+  flushLog(); // Serial writes happen here, never in the radio path
+}
+
+bool AutoCCServer::isBusy() {
+  return requestList.hasAsync();
+}
+
+void AutoCCServer::onDiscovery(AutoCCCallback callback) {
+  _discoveryCallback = callback;
+}
+
+// probe every client, and download options from any that have come online
+bool AutoCCServer::checkAwakeStatusAsync() {
+  bool allSent = true;
+  for (int i = 0; i < numOfOnlineClients; i++) {
+    if (sendAsync(i, generateUniqueId(), REQUEST_AWAKE, 0)) {
+      onlineClients[i].isProbing = true;
+    } else {
+      allSent = false;
+    }
+  }
+  return allSent;
+}
+
+bool AutoCCServer::sendAsync(int i, unsigned long uniqueId, int request, int value) {
+  return sendListed(uniqueId, request, i, value);
+}
+
+void AutoCCServer::handleAsyncResult(const structure_pending_request& pending) {
+  const bool success = pending.isComplete;
+  const int i = pending.clientIndex;
+
+  switch (pending.request) {
+    case REQUEST_AWAKE:
+      handleProbeResult(i, success);
+      break;
+    case REQUEST_ALLOCATE_ID:
+      if (success) {
+        requestOptionCount(i);
+      } else {
+        finishDiscovery(i);
+      }
+      break;
+    case REQUEST_COUNT:
+      if (success) {
+        startOptionDownload(i, pending.value);
+      } else {
+        finishDiscovery(i);
+      }
+      break;
+    case REQUEST_OPTION_BATCH:
+      if (success && pending.value > 0) {
+        _discoveries[i].nextOption += pending.value;
+        _discoveries[i].numOfFinished += pending.value;
+        _discoveries[i].numOfReceived += pending.value;
+      } else {
+        // clients without batch support never answer, so fall back to single options
+        _discoveries[i].useBatches = false;
+      }
+      requestNextOptions(i);
+      break;
+    case REQUEST_VALUE_BATCH:
+      if (success && pending.value > 0) {
+        _discoveries[i].nextOption += pending.value;
+        _discoveries[i].numOfFinished += pending.value;
+      } else {
+        _discoveries[i].numOfFinished = _discoveries[i].numOfOptions; // keep the cached values
+      }
+      requestNextOptions(i);
+      break;
+    case REQUEST_OPTION:
+      _discoveries[i].numOfInFlight--;
+      _discoveries[i].numOfFinished++;
+      if (success) {
+        _discoveries[i].numOfReceived++;
+      }
+      requestNextOptions(i);
+      break;
+    default:
+      break;
+  }
+
+  if (pending.callback != nullptr) {
+    pending.callback(pending.uniqueId, success, pending.value);
+  }
+}
+
+void AutoCCServer::handleProbeResult(int i, bool isOnline) {
+  logInfo(onlineClients[i].label, (isOnline) ? " is online" : " is offline");
+
+  structure_online_client& client = onlineClients[i];
+  client.isProbing = false;
+  if (isOnline) {
+    client.lastSeen = millis();
+    client.probeBackoff = PROBE_BACKOFF_MIN;
+  } else {
+    // back off exponentially while it stays offline
+    if (client.isOnline == OFFLINE) {
+      client.probeBackoff = std::min(client.probeBackoff * 2, (unsigned long)PROBE_BACKOFF_MAX);
+    }
+    client.nextProbe = millis() + client.probeBackoff;
+  }
+
+  // if currrently flagged offline, and now saying online, and has no options, then get options
+  if ((onlineClients[i].isOnline == OFFLINE) && (isOnline) && (onlineClients[i].numOfOptions == 0)) {
+    startDiscovery(i);
+  }
+  setOnline(i, isOnline);
+}
+
+// logs the client coming or going in the change log
+void AutoCCServer::setOnline(int i, bool isOnline) {
+  if (onlineClients[i].isOnline == isOnline) return;
+  onlineClients[i].isOnline = isOnline;
+  _changeLog.add(onlineClients[i].uniqueId, isOnline ? ONLINE : OFFLINE, CHANGE_CLIENT);
+}
+
+void AutoCCServer::startDiscovery(int i) {
+  if (_discoveries[i].isActive) return;
+
+  resetDiscovery(i);
+  _discoveries[i].isActive = true;
+  onlineClients[i].hasAnnounced = false; // this discovery answers any announce received so far
+  logDebug("Id allocated to server: ", onlineClients[i].uniqueId);
+  if (!sendAsync(i, onlineClients[i].uniqueId, REQUEST_ALLOCATE_ID, 0)) {
+    finishDiscovery(i);
+  }
+}
+
+// clears the progress of a download, keeping what is known about the client's menu
+void AutoCCServer::resetDiscovery(int i) {
+  const unsigned long menuBaseId = _discoveries[i].menuBaseId;
+  const uint32_t menuFingerprint = _discoveries[i].menuFingerprint;
+  _discoveries[i] = {};
+  _discoveries[i].menuBaseId = menuBaseId;
+  _discoveries[i].menuFingerprint = menuFingerprint;
+}
+
+/* The client gives option k the id countId + k, so enough ids are
+reserved for a cached menu to be reused as is. A client that already
+has a menu, e.g. one that rebooted and announced itself, is given its
+old ids back
+*/
+void AutoCCServer::requestOptionCount(int i) {
+  resetDiscovery(i);
+  structure_discovery& discovery = _discoveries[i];
+  discovery.isActive = true;
+  discovery.countId = (discovery.menuBaseId != 0)
+    ? discovery.menuBaseId
+    : generateUniqueId(std::max(_menuCache.numOfOptions(onlineClients[i].macAddress), 1));
+  if (!sendAsync(i, discovery.countId, REQUEST_COUNT, 0)) {
+    finishDiscovery(i);
+  }
+}
+
+/* Option j is requested with uniqueId baseId + j, either as part of a
+FLAG_OPTION_BATCH frame or on its own with up to DISCOVERY_WINDOW in flight
+*/
+void AutoCCServer::startOptionDownload(int i, int numOfOptions) {
+  logInfo(numOfOptions, " options to get");
+  structure_discovery& discovery = _discoveries[i];
+  const int numOfKnown = onlineClients[i].numOfOptions;
+  onlineClients[i].numOfOptions = numOfOptions;
+
+  if (discovery.menuBaseId != 0) {
+    // the menu is already there, and the client took its old ids back
+    if (discovery.countId == discovery.menuBaseId && discovery.fingerprint == discovery.menuFingerprint && numOfOptions == numOfKnown) {
+      discovery.numOfOptions = numOfOptions;
+      discovery.baseId = discovery.countId;
+      discovery.numOfReceived = numOfOptions;
+      discovery.isRestoring = true;
+      requestNextOptions(i);
+      return;
+    }
+    removeClientMenu(i);
+    discovery.menuBaseId = 0;
+  }
+
+  if (numOfOptions > 0 && restoreMenu(i, numOfOptions)) return;
+
+  discovery.numOfOptions = numOfOptions;
+  discovery.baseId = generateUniqueId(std::max(numOfOptions, 1));
+  discovery.useBatches = true;
+  requestNextOptions(i);
+}
+
+// adds the cached menu if the client's fingerprint still matches, then only values are requested
+bool AutoCCServer::restoreMenu(int i, int numOfOptions) {
+  structure_discovery& discovery = _discoveries[i];
+  std::vector<structure_option> options;
+  if (!_menuCache.load(onlineClients[i].macAddress, discovery.fingerprint, numOfOptions, options)) {
+    return false;
+  }
+  logInfo(numOfOptions, " options restored from the cache");
+
+  discovery.numOfOptions = numOfOptions;
+  discovery.baseId = discovery.countId;
+  discovery.isRestoring = true;
+  for (int k = 0; k < numOfOptions; k++) {
+    options[k].uniqueId = discovery.baseId + k;
+    options[k].clientId = onlineClients[i].uniqueId;
+    addMenuItem(options[k]);
+  }
+  discovery.numOfReceived = numOfOptions;
+
+  requestNextOptions(i);
+  return true;
+}
+
+// caches a fully downloaded menu, in client order
+void AutoCCServer::saveMenu(int i) {
+  const structure_discovery& discovery = _discoveries[i];
+  std::vector<structure_option> options;
+  for (int k = 0; k < discovery.numOfOptions; k++) {
+    const int slot = findMenuItem(discovery.baseId + k);
+    if (slot < 0) return;
+    options.push_back(menuItems[slot]);
+  }
+
+  if (!_menuCache.save(onlineClients[i].macAddress, discovery.fingerprint, options)) {
+    logError("Error caching menu of ", onlineClients[i].label);
+  }
+}
+
+void AutoCCServer::requestNextOptions(int i) {
+  structure_discovery& discovery = _discoveries[i];
+  if (!discovery.isActive) return;
+
+  if (discovery.numOfFinished >= discovery.numOfOptions) {
+    finishDiscovery(i);
+    return;
+  }
+
+  if (discovery.isRestoring) {
+    if (!sendAsync(i, discovery.baseId + discovery.nextOption, REQUEST_VALUE_BATCH, discovery.nextOption)) {
+      finishDiscovery(i);
+    }
+    return;
+  }
+
+  if (discovery.useBatches) {
+    if (sendAsync(i, discovery.baseId + discovery.nextOption, REQUEST_OPTION_BATCH, discovery.nextOption)) {
+      return;
+    }
+    discovery.useBatches = false;
+  }
+
+  while (discovery.numOfInFlight < DISCOVERY_WINDOW && discovery.nextOption < discovery.numOfOptions) {
+    if (sendAsync(i, discovery.baseId + discovery.nextOption, REQUEST_OPTION, discovery.nextOption)) {
+      discovery.numOfInFlight++;
+    } else {
+      logError("Error requesting option ", discovery.nextOption);
+      discovery.numOfFinished++;
+    }
+    discovery.nextOption++;
+  }
+
+  if (discovery.numOfFinished >= discovery.numOfOptions) {
+    finishDiscovery(i);
+  }
+}
+
+void AutoCCServer::finishDiscovery(int i) {
+  structure_discovery& discovery = _discoveries[i];
+  if (!discovery.isActive) return;
+
+  discovery.isActive = false;
+  logInfo(discovery.numOfReceived, " options received");
+
+  if (discovery.numOfOptions > 0 && discovery.numOfReceived == discovery.numOfOptions) {
+    discovery.menuBaseId = discovery.baseId;
+    discovery.menuFingerprint = discovery.fingerprint;
+    if (!discovery.isRestoring) {
+      saveMenu(i);
+    }
+  }
+
+  if (_discoveryCallback != nullptr) {
+    _discoveryCallback(onlineClients[i].uniqueId, discovery.numOfReceived == discovery.numOfOptions, discovery.numOfReceived);
+  }
+}
+
+/* Passive liveness - any frame from a client counts as a sign of life, so
+online clients are only probed after SILENCE_THRESHOLD of silence, and
+offline clients are re-probed with an exponential backoff
+*/
+void AutoCCServer::checkLiveness() {
+  const unsigned long now = millis();
+
+  for (int i = 0; i < numOfOnlineClients; i++) {
+    structure_online_client& client = onlineClients[i];
+    if (client.isProbing || _discoveries[i].isActive) continue;
+
+    const bool isDue = (client.isOnline)
+      ? (now - client.lastSeen >= SILENCE_THRESHOLD)
+      : ((long)(now - client.nextProbe) >= 0);
+    if (!isDue) continue;
+
+    if (sendAsync(i, generateUniqueId(), REQUEST_AWAKE, 0)) {
+      client.isProbing = true;
+    }
+  }
+}
+
+// rediscovers clients that announced themselves, e.g. after booting later than the server
+void AutoCCServer::checkAnnouncements() {
+  for (int i = 0; i < numOfOnlineClients; i++) {
+    structure_online_client& client = onlineClients[i];
+    if (!client.hasAnnounced || _discoveries[i].isActive) continue; // picked up once the current download ends
+
+    setOnline(i, ONLINE);
+    client.lastSeen = millis();
+    client.probeBackoff = PROBE_BACKOFF_MIN;
+    logInfo(client.label, " announced itself");
+    startDiscovery(i);
+  }
+}
+
+// called for every received frame
+void AutoCCServer::noteFrameFrom(const byte macAddress[6]) {
+  const int i = findClientFromMac(macAddress);
+  if (i < 0) return;
+
+  onlineClients[i].lastSeen = millis();
+  if (onlineClients[i].isOnline == OFFLINE) {
+    onlineClients[i].nextProbe = onlineClients[i].lastSeen; // it's back, confirm on the next poll
+  }
+}
+
+// blocks until every option download has finished
+void AutoCCServer::waitForDiscoveries() {
+  for (int i = 0; i < numOfOnlineClients; i++) {
+    while (_discoveries[i].isActive) {
+      waitForReply(timeUntilNextDeadline());
+      poll();
+    }
+  }
+}
+
+
 
 /* CONTROL LIST MANAGEMENT */
 
 /* Add to list, check list, delete from list
-Used for potential future multithreading and error tracking
+Requests are listed before they are sent, and the receive callback wakes
+the task waiting on a request as soon as its reply arrives
 */
 
-bool AutoCCServer::startTimeout(unsigned long uniqueId, int timeout) {
-  addToRequestList(uniqueId);
+// waits for an already listed request, which is dropped from the list on timeout
+bool AutoCCServer::startTimeout(unsigned long uniqueId, int request, int timeout) {
   unsigned long startTime = millis();
-  while(millis() - startTime < timeout) {
-    if (!isInRequestList(uniqueId)) {
-      return true;
+  structure_pending_request pending;
+  while (!requestList.takeCompleted(uniqueId, request, pending)) {
+    const unsigned long elapsed = millis() - startTime;
+    if (elapsed >= (unsigned long)timeout) {
+      if (!requestList.take(uniqueId, request, pending)) return false;
+      if (pending.isComplete) return true; // answered as the wait ran out
+
+      logInfo(uniqueId, " timed out");
+      metrics.recordTimeout(pending.clientIndex);
+      return false;
     }
-    delay(100);
+    retryRequests();
+    waitForReply(std::min(timeout - elapsed, timeUntilNextDeadline()));
   }
-  return false;
+  return true;
+}
+
+// blocks the calling task until a frame arrives, or timeout ms pass, then handles what came in
+void AutoCCServer::waitForReply(unsigned long timeout) {
+  if (receiveQueue.size() == 0) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout));
+  }
+  handleReceived();
+}
+
+// time until a request is due to finish or be sent again
+unsigned long AutoCCServer::timeUntilNextDeadline() {
+  const unsigned long now = millis();
+  return requestList.timeUntilNextRetry(now, requestList.timeUntilNextDeadline(now, REQUEST_TIMEOUT));
+}
+
+/* Requests are listed before they are sent, and stay listed only if the
+send worked. Anything unanswered after REQUEST_RETRY_INTERVAL is sent
+again under the same sequence number, so the client can tell it apart
+from a new request, up to REQUEST_MAX_SENDS times
+*/
+bool AutoCCServer::sendListed(unsigned long requestId, int request, int clientIndex, int value, AutoCCCallback callback, bool isAsync) {
+  structure_pending_request pending;
+  if (!addToRequestList(pending, requestId, request, clientIndex, value, callback, isAsync)) return false;
+
+  if (!transmit(pending)) {
+    metrics.recordSendFailure(clientIndex);
+    removeFromRequestList(requestId, request);
+    return false;
+  }
+  return true;
+}
+
+/* Sends a listed request to the client it's for. Nothing is sent without
+one - sent to every client, each resend would reach them under a new
+sequence number and be applied and answered again
+*/
+bool AutoCCServer::transmit(const structure_pending_request& pending) {
+  if (pending.request == REQUEST_SET_VALUES) {
+    for (structure_packed_request& packed : _packedRequests) {
+      if (packed.uniqueId == pending.uniqueId) {
+        return _link.send(onlineClients[packed.clientIndex].macAddress, packed.frame, packed.len, pending.seq);
+      }
+    }
+    return false;
+  }
+
+  if (pending.clientIndex < 0 || pending.clientIndex >= numOfOnlineClients) return false;
+  return sendRequest(_link, onlineClients[pending.clientIndex].macAddress, pending.uniqueId, pending.request, pending.sentValue, 0, pending.seq);
 }
 
-void AutoCCServer::addToRequestList(unsigned long requestId) {
-  print(requestId, " added to the requestList");
-  requestList.push_back(requestId);
+void AutoCCServer::retryRequests() {
+  structure_pending_request pending;
+  while (requestList.takeRetry(millis(), pending)) {
+    logDebug(pending.uniqueId, " sent again");
+    metrics.recordRetry(pending.clientIndex);
+    if (!transmit(pending)) {
+      metrics.recordSendFailure(pending.clientIndex);
+    }
+  }
 }
 
+bool AutoCCServer::addToRequestList(structure_pending_request& pending, unsigned long requestId, int request, int clientIndex, int value, AutoCCCallback callback, bool isAsync) {
+  const bool hasClient = clientIndex >= 0 && clientIndex < numOfOnlineClients;
+  pending.uniqueId     = requestId;
+  pending.waiter       = xTaskGetCurrentTaskHandle();
+  pending.request      = request;
+  pending.clientIndex  = clientIndex;
+  pending.sentValue    = value;
+  pending.seq          = hasClient ? _link.reserveSeq(onlineClients[clientIndex].macAddress) : 0;
+  pending.numOfSends   = 1;
+  pending.retryAt      = millis() + REQUEST_RETRY_INTERVAL;
+  pending.sentAt       = millis();
+  pending.value        = 0;
+  pending.isComplete   = false;
+  pending.isAsync      = isAsync;
+  pending.deadline     = millis() + REQUEST_TIMEOUT;
+  pending.callback     = callback;
+
+  if (!requestList.add(pending)) {
+    logError(requestId, " could not be added to the requestList");
+    return false;
+  }
+  logDebug(requestId, " added to the requestList");
+  return true;
+}
 
-bool AutoCCServer::isInRequestList(unsigned long requestId) {
-  return std::find(requestList.begin(), requestList.end(), requestId) != requestList.end();
+
+bool AutoCCServer::isInRequestList(unsigned long requestId, int request) {
+  return requestList.contains(requestId, request);
+}
+
+// true if a setValue for the item is waiting on this value
+bool AutoCCServer::isAwaitedValue(unsigned long uniqueId, int value) {
+  structure_pending_request pending;
+  return requestList.find(uniqueId, REQUEST_SET_VALUE, pending) && pending.sentValue == value;
 }
 
 
-bool AutoCCServer::removeFromRequestList(unsigned long requestId) {
-    auto it = std::find(requestList.begin(), requestList.end(), requestId);
-    if (it != requestList.end()) {
-        print(requestId, " removed from requestList");
-        requestList.erase(it);
+bool AutoCCServer::removeFromRequestList(unsigned long requestId, int request) {
+    if (requestList.remove(requestId, request)) {
+        logDebug(requestId, " removed from requestList");
         return true;
     }
-    print(requestId, " not found in requestList");
+    logDebug(requestId, " not found in requestList");
     return false;
 }
 
+/* called from the receive path - marks the request answered, for its
+waiter or poll() to take. Item ids double as request ids, so a reply only
+answers a request of its own type
+*/
+bool AutoCCServer::completeRequest(unsigned long requestId, int request, int value) {
+    structure_pending_request pending;
+    if (!requestList.complete(requestId, request, value, pending)) {
+        logDebug(requestId, " not found in requestList");
+        return false;
+    }
+
+    logDebug(requestId, " completed");
+    metrics.recordReply(pending.clientIndex, millis() - pending.sentAt);
+    return true;
+}
+
 
 
 /* RECEIVED DATA CALLBACK HANDLING */
@@ -227,88 +1098,310 @@ used when passing requests and single value responses
 void AutoCCServer::handleRequest(const structure_request sentRequest) {
   switch (sentRequest.request) {
     case REQUEST_COUNT:     
-      _numOfOptionsToGet = sentRequest.value;
+      logDebug(sentRequest.value, " options reported");
+      for (structure_discovery& discovery : _discoveries) {
+        if (discovery.isActive && discovery.countId == sentRequest.uniqueId) {
+          discovery.fingerprint = sentRequest.fingerprint;
+        }
+      }
       break;
     case REQUEST_ALLOCATE_ID:
-      print("ID allocated");
+      logDebug("ID allocated");
       break;
     case REQUEST_AWAKE:
-      print("Client is awake");
+      logDebug("Client is awake");
       break;
     case REQUEST_SET_VALUE:
+      // the reply echoes the value set, so one for a superseded value is stale
+      if (!isAwaitedValue(sentRequest.uniqueId, sentRequest.value)) {
+        logDebug(sentRequest.uniqueId, " stale reply ignored");
+        return;
+      }
       updateValue(sentRequest.uniqueId, sentRequest.value);
       break;
+    case REQUEST_SET_VALUES:
+      logDebug("Values set by client");
+      break;
     default:
-      Serial.println("Unknown request type received");
+      logError("Unknown request type received");
       break;
   }
 
-  removeFromRequestList(sentRequest.uniqueId);
+  completeRequest(sentRequest.uniqueId, sentRequest.request, sentRequest.value);
 };
 
 
+/* handles REQUEST_ANNOUNCE
+acknowledged straight away, the discovery itself is started by poll()
+*/
+void AutoCCServer::handleAnnounce(const byte macAddress[6], const structure_request& sentRequest) {
+  const int i = findClientFromMac(macAddress);
+  if (i < 0) {
+    logError("Announce received from an unknown client");
+    return;
+  }
+
+  sendRequest(_link, onlineClients[i].macAddress, sentRequest.uniqueId, REQUEST_ANNOUNCE, ON);
+  onlineClients[i].hasAnnounced = true;
+}
+
+
+/* handles REQUEST_VALUE_CHANGED
+a client changed one of its own values, only accepted from the client owning it.
+The request is echoed back as the acknowledgement, the client sends it
+again until then
+*/
+void AutoCCServer::handleValueChanged(const byte macAddress[6], const structure_request& sentRequest, int requestSeq) {
+  const int slot = findMenuItem(sentRequest.uniqueId);
+  if (slot < 0 || _menuOwners[slot] != findClientFromMac(macAddress)) {
+    logError(sentRequest.uniqueId, " changed by a client that does not own it");
+    return;
+  }
+
+  updateValue(sentRequest.uniqueId, sentRequest.value);
+  logDebug(menuItems[slot].label, " changed on the client");
+
+  uint8_t frame[MAX_FRAME_SIZE];
+  const int len = encodeRequest(frame, sizeof(frame), sentRequest);
+  if (!_link.sendReply(macAddress, frame, len, requestSeq)) {
+    metrics.recordSendFailure(_menuOwners[slot]);
+  }
+}
+
+
 /* handles FLAG_OPTION
 used for sending initial menu items from clients
 */
 void AutoCCServer::addOptionToMenu(const structure_option sentOption) {
-  menuItems.push_back(sentOption);
+  // ignore late or duplicate replies that are no longer being waited on
+  if (!isInRequestList(sentOption.uniqueId, REQUEST_OPTION)) return;
 
-  print(sentOption.label, " added to the menu");
-  removeFromRequestList(sentOption.uniqueId);
+  if (addMenuItem(sentOption)) {
+    logDebug(sentOption.label, " added to the menu");
+  }
+  completeRequest(sentOption.uniqueId, REQUEST_OPTION, 1);
 };
 
-bool AutoCCServer::checkAwakeStatus() {
-  for (int i = 0; i < numOfOnlineClients; i++) {
-    bool isOnline = testAwake(onlineClients[i].macAddress);
-    Serial.print(onlineClients[i].label);
-    Serial.print(" is ");
-    Serial.println((isOnline) ? "online" : "offline");
+/* handles FLAG_OPTION_BATCH
+unpacks every option in the frame into the menu. The reply carries how
+many were decoded, which moves the discovery on even when an option was
+already in the menu, while numOfMenuItems only counts what was added
+*/
+void AutoCCServer::addOptionBatchToMenu(const uint8_t* sentData, int len) {
+  AutoCCReader reader(sentData, len);
+  structure_option_batch batch;
+  if (!decodeBatchHeader(reader, batch)) {
+    logError("Malformed option batch received");
+    return;
+  }
+
+  if (!isInRequestList(batch.uniqueId, REQUEST_OPTION_BATCH)) return;
 
-    // if currrently flagged offline, and now saying online, and has no options, then get options
-    if ((onlineClients[i].isOnline == OFFLINE) && (isOnline) && (onlineClients[i].numOfOptions == 0)) {
-      allocateId(onlineClients[i].macAddress, onlineClients[i].uniqueId);
-      getAllOptions(i);
+  int numOfDecoded = 0;
+  for (int k = 0; k < batch.count; k++) {
+    structure_option option;
+    decodeOptionBody(reader, option);
+    if (reader.hasFailed()) {
+      logError("Option batch truncated at ", k);
+      break;
     }
-    onlineClients[i].isOnline = isOnline;
 
-    if (i == (numOfOnlineClients - 1)) {
-      return true;
+    option.uniqueId = batch.uniqueId + k;
+    option.clientId = batch.clientId;
+    numOfDecoded++;
+    if (addMenuItem(option)) {
+      logDebug(option.label, " added to the menu");
     }
   }
 
+  completeRequest(batch.uniqueId, REQUEST_OPTION_BATCH, numOfDecoded);
+};
+
+/* handles FLAG_VALUE_BATCH
+refreshes the values of a menu restored from the cache
+*/
+void AutoCCServer::addValueBatchToMenu(const uint8_t* sentData, int len) {
+  AutoCCReader reader(sentData, len);
+  structure_option_batch batch;
+  if (!decodeBatchHeader(reader, batch, FLAG_VALUE_BATCH)) {
+    logError("Malformed value batch received");
+    return;
+  }
+
+  if (!isInRequestList(batch.uniqueId, REQUEST_VALUE_BATCH)) return;
+
+  int numOfUpdated = 0;
+  for (int k = 0; k < batch.count; k++) {
+    const int value = reader.getSigned();
+    if (reader.hasFailed()) {
+      logError("Value batch truncated at ", k);
+      break;
+    }
+
+    updateValue(batch.uniqueId + k, value);
+    numOfUpdated++;
+  }
+
+  completeRequest(batch.uniqueId, REQUEST_VALUE_BATCH, numOfUpdated);
+};
+
+/* handles FLAG_STREAM
+unacknowledged telemetry samples - each is kept in its channel, timed by
+when the client published it, and becomes the menu item's value
+*/
+void AutoCCServer::addStreamSamples(const byte macAddress[6], const uint8_t* sentData, int len) {
+  AutoCCReader reader(sentData, len);
+  if (reader.getHeader() != FLAG_STREAM) return;
+  const int count = reader.getByte();
+  const int clientIndex = findClientFromMac(macAddress);
+  const unsigned long now = millis();
+
+  for (int k = 0; k < count; k++) {
+    const unsigned long uniqueId = reader.getVarint();
+    const int value = reader.getSigned();
+    const unsigned long age = reader.getVarint();
+    if (reader.hasFailed()) {
+      logError("Stream truncated at ", k);
+      break;
+    }
+
+    const int slot = findMenuItem(uniqueId);
+    if (slot < 0 || _menuOwners[slot] != clientIndex || menuItems[slot].type != TYPE_TELEMETRY) continue;
+
+    // kept out of the change log, which samples at this rate would wrap straight away
+    menuItems[slot].value = value;
+    telemetry.add(uniqueId, now - age, value);
+  }
+}
+
+/* Probes all clients, then downloads options from any that have come
+online, all of them at once
+*/
+bool AutoCCServer::checkAwakeStatus() {
+  std::vector<bool> isOnline = probeAllClients();
+
+  for (int i = 0; i < numOfOnlineClients; i++) {
+    handleProbeResult(i, isOnline[i]);
+  }
+  waitForDiscoveries();
+
   return true;
 }
 
+// counters from metrics, with the receive queue and link figures filled in
+void AutoCCServer::getMetrics(structure_metrics& snapshot) {
+  metrics.snapshot(snapshot);
+  snapshot.numOfDuplicates    = _link.numOfDuplicates();
+  snapshot.numOfDroppedFrames = receiveQueue.numOfDropped();
+  snapshot.queueDepth         = receiveQueue.size();
+  snapshot.queueHighWaterMark = receiveQueue.highWaterMark();
+}
+
 /* ESP-NOW CALLBACK FUNCTIONS */
 
+// the task calling begin is the one woken for received frames, and must make every later call
 void AutoCCServer::registerCallbacks() {
+  _loopTask = xTaskGetCurrentTaskHandle();
   esp_now_register_send_cb(onDataSent);
   esp_now_register_recv_cb(onDataRecv);
 }
 
 /* NOTE: MUST BE static functions */
+// a failed send makes the client's unanswered requests due to be sent again straight away
 void AutoCCServer::onDataSent(const uint8_t *mac_addr, esp_now_send_status_t status) {
-  print("Last Packet Send Status: ", status == ESP_NOW_SEND_SUCCESS ? "Success" : "Fail");
+  logDebug("Last Packet Send Status: ", status == ESP_NOW_SEND_SUCCESS ? "Success" : "Fail");
+  if (status == ESP_NOW_SEND_SUCCESS) return;
+
+  const int i = instance->findPeerFromMac(mac_addr);
+  if (i < 0) return;
+
+  instance->metrics.recordSendFailure(i);
+  TaskHandle_t waiter = instance->requestList.expediteRetries(i, millis());
+  if (waiter != nullptr) {
+    xTaskNotifyGive(waiter);
+  }
 }
 
+// runs in the WiFi task - only copies the frame out and wakes the loop task
 void AutoCCServer::onDataRecv(const esp_now_recv_info *recvInfo, const uint8_t *sentData, int len) {
-    int flag = sentData[0]; // Extract the flag from the received data
+    if (!instance->receiveQueue.push(recvInfo->src_addr, sentData, len)) {
+      return; // counted in receiveQueue.numOfDropped()
+    }
+    xTaskNotifyGive(instance->_loopTask);
+}
+
+// index in onlineClients of the client with macAddress, safe from the WiFi task
+int AutoCCServer::findPeerFromMac(const byte macAddress[6]) {
+  int found = -1;
+  portENTER_CRITICAL(&_peerLock);
+  for (int i = 0; i < _numOfPeerMacs && found < 0; i++) {
+    if (memcmp(_peerMacs[i], macAddress, 6) == 0) {
+      found = i;
+    }
+  }
+  portEXIT_CRITICAL(&_peerLock);
+  return found;
+}
+
+/* Frames are handled on the loop task, from poll() or while a blocking
+call waits, so the menu and client lists are only ever touched by the
+task using the server
+*/
+void AutoCCServer::handleReceived() {
+  structure_frame* frame;
+  while ((frame = receiveQueue.front()) != nullptr) {
+    handleFrame(*frame);
+    receiveQueue.pop();
+  }
+}
 
-    comm_structures receivedData; // format received data
-    memcpy(&receivedData, sentData, len);
+void AutoCCServer::handleFrame(const structure_frame& frame) {
+    const uint8_t* sentData = frame.data;
+    const int len = frame.len;
 
-    print(flag, " structure type");
+    noteFrameFrom(frame.macAddress);
+    if (!_link.accept(frame.macAddress, sentData, len)) return; // already handled
+
+    int flag = frameFlag(sentData, len); // Extract the flag from the received data
+
+    logDebug(flag, " structure type");
 
     // Handle different structure types based on the flag
     switch (flag) {
-      case FLAG_REQUEST:
-        instance->handleRequest(receivedData.request);
+      case FLAG_REQUEST: {
+        structure_request request;
+        if (!decodeRequest(sentData, len, request)) {
+          logError("Malformed request received");
+        } else if (request.request == REQUEST_ANNOUNCE) {
+          handleAnnounce(frame.macAddress, request);
+        } else if (request.request == REQUEST_VALUE_CHANGED) {
+          handleValueChanged(frame.macAddress, request, frameSeq(sentData, len));
+        } else {
+          handleRequest(request);
+        }
+        break;
+      }
+      case FLAG_OPTION: {
+        structure_option option;
+        if (decodeOption(sentData, len, option)) {
+          addOptionToMenu(option);
+        } else {
+          logError("Malformed option received");
+        }
+        break;
+      }
+      case FLAG_OPTION_BATCH:
+        addOptionBatchToMenu(sentData, len);
+        break;
+      case FLAG_VALUE_BATCH:
+        addValueBatchToMenu(sentData, len);
         break;
-      case FLAG_OPTION:
-        instance->addOptionToMenu(receivedData.option);
+      case FLAG_STREAM:
+        addStreamSamples(frame.macAddress, sentData, len);
         break;
       default:
-        print("Unknown structure type received");
+        logError("Unknown structure type received");
+        metrics.recordUnknownFrame();
         break;
     }
 }
\ No newline at end of file
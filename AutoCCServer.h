@@ -12,49 +12,185 @@
 #ifndef AutoCCServer_h
 #define AutoCCServer_h
 
-#include <list>
 #include <vector>
 #include "AutoCC.h"
+#include "AutoCCChangeLog.h"
+#include "AutoCCCodec.h"
+#include "AutoCCMenuCache.h"
+#include "AutoCCMenuJson.h"
+#include "AutoCCMetrics.h"
+#include "AutoCCLink.h"
+#include "AutoCCSceneStore.h"
+#include "AutoCCTelemetry.h"
+#include "AutoCCReceiveQueue.h"
+#include "AutoCCRequestTable.h"
 
 #define REQUEST_TIMEOUT       500 // default timeout for requests
+#define DISCOVERY_WINDOW      8   // option requests kept in flight per client
+
+// liveness timings, set with build flags to override, e.g. -DSILENCE_THRESHOLD=2000
+#ifndef SILENCE_THRESHOLD
+#define SILENCE_THRESHOLD     5000  // ms without any frame before an online client is probed
+#endif
+#ifndef PROBE_BACKOFF_MIN
+#define PROBE_BACKOFF_MIN     1000  // ms before re-probing a client that has just gone offline
+#endif
+#ifndef PROBE_BACKOFF_MAX
+#define PROBE_BACKOFF_MAX     60000 // longest gap between probes of an offline client
+#endif
+
+// progress of an option download from one client
+struct structure_discovery {
+    bool isActive;             // download in progress
+    bool useBatches;           // cleared once the client fails to answer a batch request
+    bool isRestoring;          // menu came from the cache, only values are requested
+    unsigned long countId;     // REQUEST_COUNT id, also the base id of a cached menu
+    uint32_t fingerprint;      // option setup hash reported with the count
+    unsigned long menuBaseId;  // base id of the client's complete menu, 0 if none
+    uint32_t menuFingerprint;  // fingerprint of that menu
+    unsigned long baseId;      // option j is requested with baseId + j
+    int numOfOptions;          // options the client reported
+    int nextOption;            // next option to request
+    int numOfFinished;         // options received or given up on
+    int numOfReceived;         // options received
+    int numOfInFlight;         // single option requests awaiting replies
+};
+
+// one value of a setValues call, isSet reports whether the client applied it
+struct structure_value_update {
+    unsigned long uniqueId;   // unique id of the menu item
+    int value;                 // new value
+    bool isSet;                // filled in by setValues
+};
+
+// FLAG_SET_VALUES frame kept while its request is in flight, so it can be sent again
+struct structure_packed_request {
+    unsigned long uniqueId;   // unique id of the request
+    int clientIndex;           // index in onlineClients
+    std::vector<int> items;    // index in the updates of each pair in the frame
+    int len;                   // length of frame
+    uint8_t frame[MAX_FRAME_SIZE];
+};
+
+// entry in the sorted uniqueId -> menuItems index
+struct structure_menu_index {
+    unsigned long uniqueId;   // unique id of the menu item
+    int slot;                  // index in menuItems
+};
 
 class AutoCCServer {
   public:
     AutoCCServer();
     bool begin(structure_peer* clients, int numOfDevices);
+    bool beginAsync(structure_peer* clients, int numOfDevices);
     int numOfOnlineClients = 0;
     std::vector<structure_online_client> onlineClients;
 
     std::vector<structure_option> menuItems;
     int numOfMenuItems = 0;
+
+    // JSON of the menu written in chunks, and a version that changes with any item, client or value except telemetry samples
+    int writeMenuJson(char* buffer, int size, structure_menu_cursor& cursor);
+    size_t writeMenuJson(Print& out);
+    unsigned long menuVersion();
+    int changesSince(unsigned long seq, structure_change* changes, int maxChanges);
     
-    std::list<int> requestList;
+    AutoCCRequestTable requestList;
+    AutoCCReceiveQueue receiveQueue;
+    AutoCCTelemetry telemetry;                 // recent samples of every TYPE_TELEMETRY item
+    AutoCCMetrics metrics;                     // per client round trips, timeouts and failures
+    void getMetrics(structure_metrics& snapshot);
     void resetClients(structure_peer* clients);
     bool checkAwakeStatus();
     bool setValue(unsigned long uniqueId, int newValue);
+    int setValues(structure_value_update* updates, int numOfUpdates);
+
+    // scenes are saved sets of values, applied with a single setValues
+    bool saveScene(const char* name, const structure_value_update* updates, int numOfUpdates);
+    int applyScene(const char* name);
+    bool removeScene(const char* name);
+
+    // non-blocking versions, finished by calling poll() from the main loop
+    // received frames are only handled inside poll() and the blocking calls, so every call must come from one task
+    bool checkAwakeStatusAsync();
+    unsigned long setValueAsync(unsigned long uniqueId, int newValue, AutoCCCallback callback = nullptr);
+    void onDiscovery(AutoCCCallback callback);
+    void poll();
+    bool isBusy();
   private:
     int _numOfClients = 0;
-    int _numOfOptionsToGet = 0;
+    std::vector<structure_discovery> _discoveries;
+    // the menu and its index are only used on the task calling the server, see handleReceived
+    std::vector<int> _menuOwners;              // onlineClients index owning each menuItem, -1 if unknown
+    std::vector<structure_menu_index> _menuIndex; // sorted by uniqueId
+    AutoCCCallback _discoveryCallback = nullptr;
+    AutoCCMenuCache _menuCache;
+    AutoCCLink _link;
+    AutoCCSceneStore _sceneStore;
+    std::vector<structure_packed_request> _packedRequests;
+    AutoCCChangeLog _changeLog;                // its sequence number is also the menu version
 
     bool registerAllPeers(structure_peer* clients);
-    bool getAllOptions(int i);
-    bool testAwake(byte macAddress[6]);
-    bool allocateId(byte macAddress[6], unsigned long uniqueId);
+    bool addClient(structure_peer client);
+    std::vector<bool> probeAllClients();
 
-    bool sendUpdateRequest(unsigned long uniqueId, int newValue);
+    bool sendUpdateRequest(int optionIndex, int newValue);
+    void packValues(structure_value_update* updates, int numOfUpdates);
+    int findMenuItemOf(int clientIndex, const char* memId);
+    bool addMenuItem(const structure_option& option);
+    int findMenuItem(unsigned long uniqueId);
+    int findClientFromUniqueId(unsigned long clientId);
+    int findClientFromMac(const byte macAddress[6]);
+    void checkLiveness();
+    void checkAnnouncements();
+    void noteFrameFrom(const byte macAddress[6]);
+    void setOnline(int i, bool isOnline);
     void updateValue(unsigned long uniqueId, int newValue);
     
-    bool startTimeout(unsigned long uniqueId, int timeout = REQUEST_TIMEOUT);
-    void addToRequestList(unsigned long requestId);
-    bool isInRequestList(unsigned long requestId);
-    bool removeFromRequestList(unsigned long requestId);
+    bool sendAsync(int i, unsigned long uniqueId, int request, int value);
+    void handleAsyncResult(const structure_pending_request& pending);
+    void handleProbeResult(int i, bool isOnline);
+    void startDiscovery(int i);
+    void resetDiscovery(int i);
+    void requestOptionCount(int i);
+    void startOptionDownload(int i, int numOfOptions);
+    bool restoreMenu(int i, int numOfOptions);
+    void saveMenu(int i);
+    void removeClientMenu(int i);
+    void requestNextOptions(int i);
+    void finishDiscovery(int i);
+    void waitForDiscoveries();
+
+    bool startTimeout(unsigned long uniqueId, int request, int timeout = REQUEST_TIMEOUT);
+    void waitForReply(unsigned long timeout);
+    unsigned long timeUntilNextDeadline();
+    bool sendListed(unsigned long requestId, int request, int clientIndex, int value, AutoCCCallback callback = nullptr, bool isAsync = true);
+    bool transmit(const structure_pending_request& pending);
+    void retryRequests();
+    bool addToRequestList(structure_pending_request& pending, unsigned long requestId, int request, int clientIndex, int value, AutoCCCallback callback, bool isAsync);
+    bool isInRequestList(unsigned long requestId, int request);
+    bool isAwaitedValue(unsigned long uniqueId, int value);
+    bool removeFromRequestList(unsigned long requestId, int request);
+    bool completeRequest(unsigned long requestId, int request, int value);
     
     void handleRequest(const structure_request sentRequest);
+    void handleAnnounce(const byte macAddress[6], const structure_request& sentRequest);
+    void handleValueChanged(const byte macAddress[6], const structure_request& sentRequest, int requestSeq);
     void addOptionToMenu(const structure_option option);
+    void addOptionBatchToMenu(const uint8_t* sentData, int len);
+    void addValueBatchToMenu(const uint8_t* sentData, int len);
+    void addStreamSamples(const byte macAddress[6], const uint8_t* sentData, int len);
 
     void registerCallbacks();
     static void onDataSent(const uint8_t *mac_addr, esp_now_send_status_t status);
     static void onDataRecv(const esp_now_recv_info *recvInfo, const uint8_t *sentData, int len);
+    int findPeerFromMac(const byte macAddress[6]);
+    void handleReceived();
+    void handleFrame(const structure_frame& frame);
+    TaskHandle_t _loopTask = nullptr;          // task woken when a frame is received
+    byte _peerMacs[LINK_MAX_PEERS][6];         // copy of the onlineClients MAC addresses for onDataSent
+    int _numOfPeerMacs = 0;
+    portMUX_TYPE _peerLock = portMUX_INITIALIZER_UNLOCKED;
 
     static AutoCCServer* instance;
 };
@@ -0,0 +1,54 @@
+/*
+  AutoCCStore.cpp
+
+  Andy Valentine - Valentine Autos
+
+  NVS backed persistent value storage
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include "AutoCCStore.h"
+#include "AutoCC.h"
+#include <nvs_flash.h>
+
+AutoCCNVSStore::AutoCCNVSStore(const char* name) : _name(name) {}
+
+bool AutoCCNVSStore::open() {
+  if (_isOpen) return true;
+
+  esp_err_t err = nvs_flash_init();
+  if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+    nvs_flash_erase();
+    err = nvs_flash_init();
+  }
+  if (err != ESP_OK) {
+    logError("Error initializing NVS");
+    return false;
+  }
+
+  _isOpen = nvs_open(_name, NVS_READWRITE, &_handle) == ESP_OK;
+  if (!_isOpen) {
+    logError("Error opening NVS namespace ", _name);
+  }
+  return _isOpen;
+}
+
+bool AutoCCNVSStore::get(const char* key, int32_t& value) {
+  return _isOpen && nvs_get_i32(_handle, key, &value) == ESP_OK;
+}
+
+bool AutoCCNVSStore::set(const char* key, int32_t value) {
+  return _isOpen && nvs_set_i32(_handle, key, value) == ESP_OK;
+}
+
+bool AutoCCNVSStore::commit() {
+  return _isOpen && nvs_commit(_handle) == ESP_OK;
+}
+
+void AutoCCNVSStore::close() {
+  if (!_isOpen) return;
+  nvs_close(_handle);
+  _isOpen = false;
+}
@@ -0,0 +1,45 @@
+/*
+  AutoCCStore.h
+
+  Andy Valentine - Valentine Autos
+
+  Persistent value storage used by the client. The client only talks
+  to the AutoCCStore interface, so the NVS backed store can be swapped
+  for another, e.g. a file backed one when running off device
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#ifndef AutoCCStore_h
+#define AutoCCStore_h
+
+#include <Arduino.h>
+#include <nvs.h>
+
+class AutoCCStore {
+  public:
+    virtual ~AutoCCStore() {}
+    virtual bool open() = 0;
+    virtual bool get(const char* key, int32_t& value) = 0;
+    virtual bool set(const char* key, int32_t value) = 0;   // may be buffered until commit
+    virtual bool commit() = 0;
+    virtual void close() = 0;
+};
+
+// keeps a single NVS handle open for the life of the store
+class AutoCCNVSStore : public AutoCCStore {
+  public:
+    AutoCCNVSStore(const char* name = "storage");
+    bool open() override;
+    bool get(const char* key, int32_t& value) override;
+    bool set(const char* key, int32_t value) override;
+    bool commit() override;
+    void close() override;
+  private:
+    const char* _name;
+    nvs_handle_t _handle;
+    bool _isOpen = false;
+};
+
+#endif
@@ -0,0 +1,134 @@
+/*
+  AutoCCTelemetry.cpp
+
+  Andy Valentine - Valentine Autos
+
+  Recent samples of TYPE_TELEMETRY options
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include <algorithm>
+#include "AutoCCTelemetry.h"
+
+// channels are added as telemetry options are discovered - false once TELEMETRY_MAX_CHANNELS are in use
+bool AutoCCTelemetry::addChannel(unsigned long uniqueId) {
+  bool added = true;
+  portENTER_CRITICAL(&_lock);
+  if (findChannel(uniqueId) < 0) {
+    if (_numOfChannels < TELEMETRY_MAX_CHANNELS) {
+      structure_channel& channel = _channels[_numOfChannels++];
+      channel.uniqueId = uniqueId;
+      channel.next = 0;
+      channel.count = 0;
+    } else {
+      added = false;
+    }
+  }
+  portEXIT_CRITICAL(&_lock);
+  return added;
+}
+
+void AutoCCTelemetry::removeChannel(unsigned long uniqueId) {
+  portENTER_CRITICAL(&_lock);
+  const int c = findChannel(uniqueId);
+  if (c >= 0) {
+    _channels[c] = _channels[--_numOfChannels]; // order doesn't matter
+  }
+  portEXIT_CRITICAL(&_lock);
+}
+
+// overwrites the oldest sample once the channel is full
+bool AutoCCTelemetry::add(unsigned long uniqueId, unsigned long time, int value) {
+  portENTER_CRITICAL(&_lock);
+  const int c = findChannel(uniqueId);
+  if (c >= 0) {
+    structure_channel& channel = _channels[c];
+    channel.samples[channel.next] = {time, value};
+    channel.next = (channel.next + 1) % TELEMETRY_HISTORY;
+    if (channel.count < TELEMETRY_HISTORY) channel.count++;
+  }
+  portEXIT_CRITICAL(&_lock);
+  return c >= 0;
+}
+
+bool AutoCCTelemetry::latest(unsigned long uniqueId, structure_sample& sample) {
+  bool found = false;
+  portENTER_CRITICAL(&_lock);
+  const int c = findChannel(uniqueId);
+  if (c >= 0 && _channels[c].count > 0) {
+    const structure_channel& channel = _channels[c];
+    sample = channel.samples[(channel.next + TELEMETRY_HISTORY - 1) % TELEMETRY_HISTORY];
+    found = true;
+  }
+  portEXIT_CRITICAL(&_lock);
+  return found;
+}
+
+// lowest sample in the last windowMs, or in the whole ring if windowMs is 0
+bool AutoCCTelemetry::minimum(unsigned long uniqueId, int& value, unsigned long windowMs) {
+  return extreme(uniqueId, value, windowMs, false);
+}
+
+// highest sample in the last windowMs, or in the whole ring if windowMs is 0
+bool AutoCCTelemetry::maximum(unsigned long uniqueId, int& value, unsigned long windowMs) {
+  return extreme(uniqueId, value, windowMs, true);
+}
+
+int AutoCCTelemetry::numOfSamples(unsigned long uniqueId) {
+  portENTER_CRITICAL(&_lock);
+  const int c = findChannel(uniqueId);
+  const int count = (c >= 0) ? _channels[c].count : 0;
+  portEXIT_CRITICAL(&_lock);
+  return count;
+}
+
+
+// copies the newest maxSamples samples, oldest first, e.g. for a graph - returns the number copied
+int AutoCCTelemetry::history(unsigned long uniqueId, structure_sample* samples, int maxSamples) {
+  int count = 0;
+  portENTER_CRITICAL(&_lock);
+  const int c = findChannel(uniqueId);
+  if (c >= 0 && maxSamples > 0) {
+    const structure_channel& channel = _channels[c];
+    count = std::min(channel.count, maxSamples);
+    for (int k = 0; k < count; k++) {
+      samples[k] = channel.samples[(channel.next + TELEMETRY_HISTORY - count + k) % TELEMETRY_HISTORY];
+    }
+  }
+  portEXIT_CRITICAL(&_lock);
+  return count;
+}
+
+
+
+/* CHANNELS - lock must be held */
+
+int AutoCCTelemetry::findChannel(unsigned long uniqueId) const {
+  for (int c = 0; c < _numOfChannels; c++) {
+    if (_channels[c].uniqueId == uniqueId) return c;
+  }
+  return -1;
+}
+
+bool AutoCCTelemetry::extreme(unsigned long uniqueId, int& value, unsigned long windowMs, bool isMaximum) {
+  bool found = false;
+  const unsigned long now = millis();
+
+  portENTER_CRITICAL(&_lock);
+  const int c = findChannel(uniqueId);
+  if (c >= 0) {
+    const structure_channel& channel = _channels[c];
+    for (int k = 0; k < channel.count; k++) {
+      const structure_sample& sample = channel.samples[k];
+      if (windowMs > 0 && now - sample.time > windowMs) continue;
+      if (!found || (isMaximum ? sample.value > value : sample.value < value)) {
+        value = sample.value;
+        found = true;
+      }
+    }
+  }
+  portEXIT_CRITICAL(&_lock);
+  return found;
+}
@@ -0,0 +1,54 @@
+/*
+  AutoCCTelemetry.h
+
+  Andy Valentine - Valentine Autos
+
+  Recent samples of TYPE_TELEMETRY options, kept by the server. Each
+  channel is a fixed size ring of timestamped samples, so nothing is
+  allocated as samples stream in
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#ifndef AutoCCTelemetry_h
+#define AutoCCTelemetry_h
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+
+#define TELEMETRY_HISTORY     64    // samples kept per channel
+#define TELEMETRY_MAX_CHANNELS 16   // telemetry options across every client
+
+struct structure_sample {
+    unsigned long time;        // server millis() the sample was taken at
+    int value;                 // value of the sample
+};
+
+struct structure_channel {
+    unsigned long uniqueId;   // unique id of the menu item
+    int next;                  // slot the next sample goes in
+    int count;                 // samples held, up to TELEMETRY_HISTORY
+    structure_sample samples[TELEMETRY_HISTORY];
+};
+
+class AutoCCTelemetry {
+  public:
+    bool addChannel(unsigned long uniqueId);
+    void removeChannel(unsigned long uniqueId);
+    bool add(unsigned long uniqueId, unsigned long time, int value);
+    bool latest(unsigned long uniqueId, structure_sample& sample);
+    bool minimum(unsigned long uniqueId, int& value, unsigned long windowMs = 0);
+    bool maximum(unsigned long uniqueId, int& value, unsigned long windowMs = 0);
+    int numOfSamples(unsigned long uniqueId);
+    int history(unsigned long uniqueId, structure_sample* samples, int maxSamples);
+  private:
+    structure_channel _channels[TELEMETRY_MAX_CHANNELS];
+    int _numOfChannels = 0;
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+
+    int findChannel(unsigned long uniqueId) const;
+    bool extreme(unsigned long uniqueId, int& value, unsigned long windowMs, bool isMaximum);
+};
+
+#endif
@@ -42,7 +42,7 @@ structure_peer server[] = {
 /* options for your changable menu items in the format
 id:               char[12]      - id - must be unique
 label             char[32]      - label name
-type              int           - type from TYPE_SWITCH, TYPE_RANGE, TYPE_COLOR, more tbc
+type              int           - type from TYPE_SWITCH, TYPE_RANGE, TYPE_TELEMETRY, more tbc
 range_min         int           - min value for range - 0 if not required
 range_max         int           - max value for range - 1 if not required
 value             int           - default of option
@@ -60,6 +60,13 @@ structure_option_setup options[] = {
 // numOfOptions required due to pointers
 int numOfOptions = sizeof(options) / sizeof(options[0]);
 
+/* handles resolve each option once in setup, so reading a value
+in the loop is a single array read rather than a string search
+*/
+structure_option_handle drlHandle;
+structure_option_handle brakeHandle;
+structure_option_handle glowHandle;
+
 void setNeoPixelColor(int red, int green, int blue) {
  for (int ledNumber = 0; ledNumber < NUM_PIXELS; ledNumber++) {
     NeoPixel.setPixelColor(ledNumber, red, green, blue);
@@ -70,7 +77,7 @@ void setNeoPixelColor(int red, int green, int blue) {
 void displayMode(int mode) {
   switch (mode) {
     case BRAKE_MODE:
-      if (CCClient.getValue(BRAKE_STATE)) {
+      if (CCClient.getValue(brakeHandle)) {
         Serial.println("Brake mode");
         setNeoPixelColor(255, 0, 0);  // Red with max brightness
       } else {
@@ -78,7 +85,7 @@ void displayMode(int mode) {
       }
       break;
     case GLOW_MODE:
-       if (CCClient.getValue(GLOW_STATE) == 1) {
+       if (CCClient.getValue(glowHandle) == 1) {
         Serial.println("GLOW mode");
         setNeoPixelColor(100, 0, 100);  // Red with mid brightness
       } else {
@@ -86,7 +93,7 @@ void displayMode(int mode) {
       }
       break;
     case DRL_MODE:
-      if (CCClient.getValue(DRL_STATE) == 1) {
+      if (CCClient.getValue(drlHandle) == 1) {
         Serial.println("DRL mode");
         setNeoPixelColor(100, 0, 0);  // Red with mid brightness
       } else {
@@ -111,6 +118,10 @@ void setup() {
 
   // begin the client with settings
   if (CCClient.begin(server, options, numOfOptions)) {
+    drlHandle = CCClient.getHandle(optionKey(DRL_STATE));
+    brakeHandle = CCClient.getHandle(optionKey(BRAKE_STATE));
+    glowHandle = CCClient.getHandle(optionKey(GLOW_STATE));
+
     displayMode(DRL_MODE);  // Initialize DRL mode
   }
 
@@ -137,5 +148,6 @@ void loop() {
     savedMode = currentMode;   // update the new mode value
   }
 
+  flushLog(); // writes the library's queued log lines to Serial
   delay(100); //debounce
 }
\ No newline at end of file
@@ -59,20 +59,29 @@ void handleBundle() {
   file.close();
 }
 
+/* the menu version is the ETag, so a poll with nothing changed gets a
+304 and no body. Otherwise the menu is sent in chunks from a buffer on
+the stack, so the heap isn't touched however many items there are
+*/
 void handleInputs() {
-  String response = "[";
-  for (int i = 0; i < CC.numOfMenuItems; ++i) {
-    response += "{";
-    response += "\"unique_id\":" + String(CC.menuItems[i].uniqueId) + ",";
-    response += "\"label\":\"" + String(CC.menuItems[i].label) + "\",";
-    response += "\"rangeMin\":" + String(CC.menuItems[i].rangeMin) + ",";
-    response += "\"rangeMax\":" + String(CC.menuItems[i].rangeMax) + ",";
-    response += "\"value\":" + String(CC.menuItems[i].value);
-    response += "}";
-    if (i < CC.numOfMenuItems - 1) response += ",";
+  char etag[16];
+  snprintf(etag, sizeof(etag), "\"%lu\"", CC.menuVersion());
+  server.sendHeader("ETag", etag);
+  server.sendHeader("Cache-Control", "no-cache");
+  if (server.header("If-None-Match") == etag) {
+    server.send(304);
+    return;
+  }
+
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "application/json", "");
+
+  char chunk[1024];
+  structure_menu_cursor cursor = {};
+  int len;
+  while ((len = CC.writeMenuJson(chunk, sizeof(chunk), cursor)) > 0) {
+    server.sendContent(chunk, len);
   }
-  response += "]";
-  server.send(200, "application/json", response);
 }
 
 
@@ -92,12 +101,77 @@ void handleUpdate() {
   int unique_id = doc["unique_id"];
   int value = doc["value"];
 
-  // Update the value in the CC library
-  CC.setValue(unique_id, value);
+  // Update the value in the CC library - confirmed in the background by CC.poll()
+  if (!CC.setValueAsync(unique_id, value)) {
+    server.send(400, "text/plain", "Invalid value");
+    return;
+  }
 
   server.send(200, "text/plain", "Value updated");
 }
 
+/* changes since the version the UI last saw, e.g. /changes?since=42
+answers {"version":43,"changes":[...]}, or {"version":43,"snapshot":true}
+when the changes are no longer held and /inputs has to be fetched again
+*/
+void handleChanges() {
+  const unsigned long since = strtoul(server.arg("since").c_str(), nullptr, 10);
+  structure_change changes[16];
+  const int numOfChanges = CC.changesSince(since, changes, 16);
+
+  DynamicJsonDocument doc(2048);
+  if (numOfChanges < 0) {
+    doc["version"] = CC.menuVersion();
+    doc["snapshot"] = true;
+  } else {
+    // more may follow, the UI asks again from the version given
+    doc["version"] = (numOfChanges > 0) ? changes[numOfChanges - 1].seq : since;
+    JsonArray entries = doc.createNestedArray("changes");
+    for (int c = 0; c < numOfChanges; c++) {
+      JsonObject entry = entries.createNestedObject();
+      entry["unique_id"] = changes[c].uniqueId;
+      entry["value"] = changes[c].value;
+      entry["client"] = changes[c].kind == CHANGE_CLIENT;
+    }
+  }
+
+  String response;
+  serializeJson(doc, response);
+  server.send(200, "application/json", response);
+}
+
+// link health of each client, for checking a setup in the car
+void handleMetrics() {
+  structure_metrics metrics;
+  CC.getMetrics(metrics);
+
+  DynamicJsonDocument doc(4096);
+  doc["unknownFrames"] = metrics.numOfUnknownFrames;
+  doc["duplicates"] = metrics.numOfDuplicates;
+  doc["droppedFrames"] = metrics.numOfDroppedFrames;
+  doc["queueHighWaterMark"] = metrics.queueHighWaterMark;
+
+  JsonArray peers = doc.createNestedArray("clients");
+  for (int i = 0; i < CC.numOfOnlineClients && i < METRICS_MAX_PEERS; i++) {
+    const structure_peer_metrics& peer = metrics.peers[i];
+    JsonObject entry = peers.createNestedObject();
+    entry["label"] = CC.onlineClients[i].label;
+    entry["replies"] = peer.numOfReplies;
+    entry["timeouts"] = peer.numOfTimeouts;
+    entry["retries"] = peer.numOfRetries;
+    entry["sendFailures"] = peer.numOfSendFailures;
+    entry["meanRtt"] = peer.numOfReplies ? peer.rttTotal / peer.numOfReplies : 0;
+    JsonArray buckets = entry.createNestedArray("rttBuckets");
+    for (int b = 0; b < METRICS_RTT_BUCKETS; b++) {
+      buckets.add(peer.rttBuckets[b]);
+    }
+  }
+
+  String response;
+  serializeJson(doc, response);
+  server.send(200, "application/json", response);
+}
+
 void setup()
 {
   Serial.begin(115200);
@@ -110,12 +184,18 @@ void setup()
     return;
   }
 
+  const char* headerKeys[] = {"If-None-Match"};
+  server.collectHeaders(headerKeys, 1); // for handleInputs
+
   server.on("/", handleRoot);
   server.on("/bundle.js", handleBundle);
   server.on("/inputs", handleInputs); // Endpoint for inputs array
   server.on("/update", HTTP_POST, handleUpdate); // Endpoint for updating inputs
+  server.on("/changes", handleChanges); // Endpoint for value changes since a version
+  server.on("/metrics", handleMetrics); // Endpoint for link health
 
-  if (CC.begin(clients, numOfClients)) {
+  // clients are discovered in the background by CC.poll()
+  if (CC.beginAsync(clients, numOfClients)) {
     WiFi.softAP(ssid, password);
     IPAddress IP = WiFi.softAPIP();
     Serial.print("AP IP address: ");
@@ -127,7 +207,5 @@ void setup()
 
 void loop() {
   server.handleClient();
-  CC.checkAwakeStatus();
-
-  delay(5000);
+  CC.poll(); // also keeps track of which clients are online
 }
\ No newline at end of file
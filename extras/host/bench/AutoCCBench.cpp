@@ -0,0 +1,238 @@
+/*
+  AutoCCBench.cpp
+
+  Andy Valentine - Valentine Autos
+
+  Microbenchmarks of the paths run on every frame and every menu request:
+  option lookups, value checks, the request table, the frame codec and
+  the menu JSON. Menu paths are swept over client and option counts, the
+  request table over requests in flight. Results are CSV on stdout, one
+  row per benchmark and size, so runs can be diffed in review
+
+    autocc_bench [--quick]
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "AutoCCServer.h"
+
+#define BENCH_MIN_NS          50000000  // each benchmark runs for at least this long
+#define BENCH_QUICK_NS        1000000   // with --quick, for a smoke run under ctest
+
+static long long minRunNs = BENCH_MIN_NS;
+static volatile long benchSink = 0;    // results are added here so nothing is optimised away
+
+// counts what's written, standing in for the web server's client
+class CountingPrint : public Print {
+  public:
+    size_t write(uint8_t) override { return 1; }
+    size_t write(const uint8_t*, size_t size) override { return size; }
+};
+
+static long long nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* Calls run with a growing number of operations until a pass takes at
+least minRunNs, then prints the time per operation
+*/
+template <typename Run>
+static void bench(const char* name, int numOfClients, int numOfOptions, int size, Run run) {
+  long numOfOps = 1;
+  long long elapsed = 0;
+  for (;;) {
+    const long long startTime = nowNs();
+    benchSink += run(numOfOps);
+    elapsed = nowNs() - startTime;
+    if (elapsed >= minRunNs) break;
+    numOfOps = (elapsed <= 0) ? numOfOps * 100 : std::max(numOfOps * 2, (long)(numOfOps * 1.2 * minRunNs / elapsed));
+  }
+  printf("%s,%d,%d,%d,%.1f,%ld\n", name, numOfClients, numOfOptions, size, (double)elapsed / numOfOps, numOfOps);
+}
+
+// a menu as the server holds it, clients' items in turn with sequential ids
+static std::vector<structure_option> buildMenu(int numOfClients, int numOfOptions) {
+  std::vector<structure_option> menu;
+  for (int c = 0; c < numOfClients; c++) {
+    const unsigned long baseId = 100000 + c * 1000;
+    for (int j = 0; j < numOfOptions; j++) {
+      structure_option option = {};
+      option.flag = FLAG_OPTION;
+      snprintf(option.memId, sizeof(option.memId), "opt%d", j);
+      snprintf(option.label, sizeof(option.label), "Client %d option %d", c + 1, j);
+      option.type = (j % 3 == 0) ? TYPE_SWITCH : TYPE_RANGE;
+      option.rangeMin = 0;
+      option.rangeMax = 1000;
+      option.value = j % 2;
+      option.uniqueId = baseId + j;
+      option.clientId = c + 1;
+      menu.push_back(option);
+    }
+  }
+  return menu;
+}
+
+static void benchMenu(AutoCCServer& server, int numOfClients, int numOfOptions) {
+  std::vector<structure_option> menu = buildMenu(numOfClients, numOfOptions);
+  const int numOfItems = menu.size();
+
+  // looked up in a scattered order, as replies arrive
+  std::vector<unsigned long> lookups;
+  for (int k = 0; k < numOfItems; k++) {
+    lookups.push_back(menu[(k * 7919) % numOfItems].uniqueId);
+  }
+
+  bench("find_option_array", numOfClients, numOfOptions, numOfItems, [&](long numOfOps) {
+    long found = 0;
+    for (long op = 0; op < numOfOps; op++) {
+      found += findOptionFromUniqueId(menu.data(), numOfItems, lookups[op % numOfItems]);
+    }
+    return found;
+  });
+
+  bench("find_option_vector", numOfClients, numOfOptions, numOfItems, [&](long numOfOps) {
+    long found = 0;
+    for (long op = 0; op < numOfOps; op++) {
+      found += findOptionFromUniqueId(menu, numOfItems, lookups[op % numOfItems]);
+    }
+    return found;
+  });
+
+  // the server's own lookup, a binary search of its index sorted by unique id
+  std::vector<structure_menu_index> index;
+  for (int slot = 0; slot < numOfItems; slot++) {
+    index.push_back({menu[slot].uniqueId, slot});
+  }
+  std::sort(index.begin(), index.end(), [](const structure_menu_index& a, const structure_menu_index& b) {
+    return a.uniqueId < b.uniqueId;
+  });
+  bench("find_menu_index", numOfClients, numOfOptions, numOfItems, [&](long numOfOps) {
+    long found = 0;
+    for (long op = 0; op < numOfOps; op++) {
+      const unsigned long uniqueId = lookups[op % numOfItems];
+      auto it = std::lower_bound(index.begin(), index.end(), uniqueId, [](const structure_menu_index& entry, unsigned long id) {
+        return entry.uniqueId < id;
+      });
+      found += (it != index.end() && it->uniqueId == uniqueId) ? it->slot : -1;
+    }
+    return found;
+  });
+
+  bench("is_valid_value", numOfClients, numOfOptions, numOfItems, [&](long numOfOps) {
+    long valid = 0;
+    for (long op = 0; op < numOfOps; op++) {
+      valid += isValidValue(menu[op % numOfItems], op & 1023);
+    }
+    return valid;
+  });
+
+  server.menuItems = menu;
+  server.numOfMenuItems = numOfItems;
+  bench("menu_json", numOfClients, numOfOptions, numOfItems, [&](long numOfOps) {
+    CountingPrint out;
+    long written = 0;
+    for (long op = 0; op < numOfOps; op++) {
+      written += server.writeMenuJson(out);
+    }
+    return written;
+  });
+  server.menuItems.clear();
+  server.numOfMenuItems = 0;
+}
+
+// one request added, found and removed with inFlight - 1 others waiting
+static void benchRequestTable(int inFlight) {
+  AutoCCRequestTable table;
+  structure_pending_request pending = {};
+  pending.request = REQUEST_SET_VALUE;
+  for (int r = 0; r < inFlight - 1; r++) {
+    pending.uniqueId = 200000 + r;
+    table.add(pending);
+  }
+
+  bench("request_table", 0, 0, inFlight, [&](long numOfOps) {
+    long found = 0;
+    for (long op = 0; op < numOfOps; op++) {
+      pending.uniqueId = 300000 + (op & 0xffff);
+      table.add(pending);
+      found += table.contains(pending.uniqueId, REQUEST_SET_VALUE);
+      found += table.remove(pending.uniqueId, REQUEST_SET_VALUE);
+    }
+    return found;
+  });
+}
+
+static void benchCodec() {
+  uint8_t frame[MAX_FRAME_SIZE];
+  const structure_request request = {FLAG_REQUEST, 123456, REQUEST_SET_VALUE, 512, 0};
+  const std::vector<structure_option> menu = buildMenu(1, 1);
+  const structure_option& option = menu[0];
+  const int requestLen = encodeRequest(frame, sizeof(frame), request);
+  const int optionLen = encodeOption(frame, sizeof(frame), option);
+
+  // size is the encoded length
+  bench("encode_request", 0, 0, requestLen, [&](long numOfOps) {
+    long len = 0;
+    for (long op = 0; op < numOfOps; op++) {
+      len += encodeRequest(frame, sizeof(frame), request);
+    }
+    return len;
+  });
+
+  encodeRequest(frame, sizeof(frame), request);
+  bench("decode_request", 0, 0, requestLen, [&](long numOfOps) {
+    structure_request decoded;
+    long decodedCount = 0;
+    for (long op = 0; op < numOfOps; op++) {
+      decodedCount += decodeRequest(frame, requestLen, decoded);
+    }
+    return decodedCount;
+  });
+
+  bench("encode_option", 0, 0, optionLen, [&](long numOfOps) {
+    long len = 0;
+    for (long op = 0; op < numOfOps; op++) {
+      len += encodeOption(frame, sizeof(frame), option);
+    }
+    return len;
+  });
+
+  encodeOption(frame, sizeof(frame), option);
+  bench("decode_option", 0, 0, optionLen, [&](long numOfOps) {
+    structure_option decoded;
+    long decodedCount = 0;
+    for (long op = 0; op < numOfOps; op++) {
+      decodedCount += decodeOption(frame, optionLen, decoded);
+    }
+    return decodedCount;
+  });
+}
+
+int main(int argc, char** argv) {
+  for (int a = 1; a < argc; a++) {
+    if (strcmp(argv[a], "--quick") == 0) {
+      minRunNs = BENCH_QUICK_NS;
+    } else {
+      fprintf(stderr, "usage: autocc_bench [--quick]\n");
+      return 2;
+    }
+  }
+  hostSerial(false);
+
+  printf("benchmark,clients,options,size,ns_per_op,ops\n");
+  AutoCCServer server;
+  for (int numOfClients : {1, 5, 20}) {
+    for (int numOfOptions : {10, 30, 100}) {
+      benchMenu(server, numOfClients, numOfOptions);
+    }
+  }
+  for (int inFlight : {1, 8, 32, REQUEST_TABLE_SIZE - 1}) {
+    benchRequestTable(inFlight);
+  }
+  benchCodec();
+  return 0;
+}
@@ -0,0 +1,67 @@
+/*
+  Arduino.h
+
+  Andy Valentine - Valentine Autos
+
+  Host shim of the parts of the ESP32 Arduino core the library uses, so
+  it builds and runs on Linux. Time comes from the steady clock, and
+  Serial writes to stdout once hostSerial(true) is called
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+typedef uint8_t byte;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+uint32_t esp_random();
+
+class Print {
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size);
+
+    size_t print(const char* text);
+    size_t print(char c);
+    size_t print(int number);
+    size_t print(unsigned int number);
+    size_t print(long number);
+    size_t print(unsigned long number);
+    size_t print(double number);
+    size_t println();
+    size_t println(const char* text);
+    size_t println(int number);
+    size_t println(unsigned int number);
+    size_t println(long number);
+    size_t println(unsigned long number);
+    size_t println(double number);
+    size_t printf(const char* format, ...);
+};
+
+class HardwareSerial : public Print {
+  public:
+    void begin(unsigned long baud);
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+};
+
+extern HardwareSerial Serial;
+
+// Serial output is dropped unless turned on, so many devices can share a terminal
+void hostSerial(bool isEnabled);
+
+#endif
@@ -0,0 +1,90 @@
+/*
+  HostFleet.cpp
+
+  Andy Valentine - Valentine Autos
+
+  Fleet of simulated clients, one process each
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include "HostFleet.h"
+#include "AutoCCClient.h"
+#include "AutoCCLog.h"
+
+// runs in the client's own process until the test ends
+static void runClient(int node, void* parameter) {
+  const int numOfOptions = *static_cast<int*>(parameter);
+
+  structure_peer server[1];
+  fleetServerPeer(server[0]);
+
+  structure_option_setup* options = new structure_option_setup[numOfOptions];
+  for (int j = 0; j < numOfOptions; j++) {
+    snprintf(options[j].id, sizeof(options[j].id), "opt%d", j % 100000);
+    snprintf(options[j].label, sizeof(options[j].label), "Client %d option %d", node, j);
+    options[j].type = TYPE_RANGE;
+    options[j].rangeMin = 0;
+    options[j].rangeMax = 1000;
+    options[j].value = j;
+  }
+
+  AutoCCClient* client = new AutoCCClient();
+  client->begin(server, options, numOfOptions);
+  for (;;) {
+    flushLog();
+    delay(10);
+  }
+}
+
+bool fleetIsOnline(const structure_fleet_config& config, int clientIndex) {
+  // spread the offline clients out through the list
+  const int offlineBefore = (int)(clientIndex * config.offlineShare);
+  const int offlineAfter = (int)((clientIndex + 1) * config.offlineShare);
+  return offlineAfter == offlineBefore;
+}
+
+static int numOfOptions;                    // read by each client as it starts
+
+int fleetSpawn(const structure_fleet_config& config, structure_peer* peers) {
+  numOfOptions = config.numOfOptions;
+
+  int numOfStarted = 0;
+  for (int k = 0; k < config.numOfClients && k < FLEET_MAX_CLIENTS; k++) {
+    snprintf(peers[k].label, sizeof(peers[k].label), "Client %d", k + 1);
+    radioMac(k + 1, peers[k].macAddress);
+    if (!fleetIsOnline(config, k)) continue;
+
+    radioSpawn(k + 1, runClient, &numOfOptions);
+    numOfStarted++;
+  }
+
+  for (int k = 0; k < config.numOfClients && k < FLEET_MAX_CLIENTS; k++) {
+    if (fleetIsOnline(config, k) && !radioWaitForListening(k + 1, 5000)) {
+      fprintf(stderr, "Client %d never started\n", k + 1);
+    }
+  }
+  return numOfStarted;
+}
+
+bool fleetStartClient(const structure_fleet_config& config, int clientIndex) {
+  if (clientIndex >= FLEET_MAX_CLIENTS || radioIsListening(clientIndex + 1)) return false;
+
+  numOfOptions = config.numOfOptions;
+  radioSpawn(clientIndex + 1, runClient, &numOfOptions);
+  return radioWaitForListening(clientIndex + 1, 5000);
+}
+
+void fleetServerPeer(structure_peer& peer) {
+  snprintf(peer.label, sizeof(peer.label), "Server");
+  radioMac(RADIO_SERVER_NODE, peer.macAddress);
+}
+
+unsigned long elapsedMs(unsigned long startTime) {
+  return millis() - startTime;
+}
+
+unsigned long elapsedUs(unsigned long startTime) {
+  return micros() - startTime;
+}
@@ -0,0 +1,45 @@
+/*
+  HostFleet.h
+
+  Andy Valentine - Valentine Autos
+
+  Spawns a fleet of simulated AutoCCClient devices on the host radio,
+  each with its own set of range options, for the sim and tests to run
+  a server against
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#ifndef HostFleet_h
+#define HostFleet_h
+
+#include "AutoCC.h"
+#include "HostRadio.h"
+
+#define FLEET_MAX_CLIENTS     (RADIO_MAX_NODES - 1)
+
+struct structure_fleet_config {
+    int numOfClients;          // clients in the server's list, online or not
+    int numOfOptions;          // options on each client
+    double offlineShare;       // share of the clients never started
+};
+
+/* Starts every online client, waits for each to be listening, then fills
+in peers for the server's begin. Client k is node k + 1, and its option j
+has the id "opt<j>" and starts at value j. Returns the number started
+*/
+int fleetSpawn(const structure_fleet_config& config, structure_peer* peers);
+bool fleetIsOnline(const structure_fleet_config& config, int clientIndex);
+
+// starts a client fleetSpawn left offline, e.g. one booting after the server
+bool fleetStartClient(const structure_fleet_config& config, int clientIndex);
+
+// the server as a client lists it, at RADIO_SERVER_NODE
+void fleetServerPeer(structure_peer& peer);
+
+// milliseconds and microseconds since startTime, for timing results
+unsigned long elapsedMs(unsigned long startTime);
+unsigned long elapsedUs(unsigned long startTime);
+
+#endif
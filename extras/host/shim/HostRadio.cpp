@@ -0,0 +1,342 @@
+/*
+  HostRadio.cpp
+
+  Andy Valentine - Valentine Autos
+
+  Simulated ESP-NOW radio, one process per device. esp_now_send queues
+  the frame with its delivery time, a delivery thread hands it to the
+  receiving process's socket when due and then fires the send callback,
+  and a receive thread fires the receive callback as the WiFi task would
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include <esp_now.h>
+#include "HostRadio.h"
+#include "AutoCCCodec.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define RADIO_PPM             1000000
+
+// shared by every device, mapped before the first fork
+struct structure_radio_shared {
+    pid_t groupPid;                            // names the sockets, so test runs can't cross
+    std::atomic<unsigned long> latency;
+    std::atomic<unsigned long> jitter;
+    std::atomic<uint32_t> lossPpm;
+    std::atomic<uint32_t> reorderPpm;
+    std::atomic<long> numOfFrames;
+    std::atomic<long> numOfBytes;
+    std::atomic<long> numOfLost;
+    std::atomic<long> numOfUndelivered;
+    std::atomic<long> numOfFlag[RADIO_MAX_FLAGS];
+    std::atomic<long> numOfRequest[RADIO_MAX_REQUESTS];
+    std::atomic<bool> isListening[RADIO_MAX_NODES];
+    pid_t pids[RADIO_MAX_NODES];               // process of each spawned device, 0 if none
+};
+
+struct structure_radio_frame {
+    int to;                    // node, -1 if the address isn't a simulated device
+    byte macAddress[6];        // address it was sent to
+    bool isLost;
+    int len;
+    uint8_t data[6 + ESP_NOW_MAX_DATA_LEN];  // sender's MAC address, then the frame
+};
+
+// this process's device
+struct structure_radio_device {
+    int node = -1;
+    int socket = -1;
+    std::atomic<esp_now_send_cb_t> sendCallback{nullptr};
+    std::atomic<esp_now_recv_cb_t> recvCallback{nullptr};
+    std::mutex lock;
+    std::condition_variable isQueued;
+    std::multimap<unsigned long, structure_radio_frame> queue;  // by delivery time, in micros
+    std::mt19937 random;
+};
+
+static structure_radio_shared* shared = nullptr;
+static structure_radio_device* device = new structure_radio_device();
+
+/* ADDRESSES */
+
+void radioMac(int node, byte macAddress[6]) {
+  const byte base[6] = {0x02, 0x00, 0x00, 0x00, 0x00, (byte)node};
+  memcpy(macAddress, base, 6);
+}
+
+static int nodeFromMac(const uint8_t macAddress[6]) {
+  const byte base[5] = {0x02, 0x00, 0x00, 0x00, 0x00};
+  if (memcmp(macAddress, base, 5) != 0 || macAddress[5] >= RADIO_MAX_NODES) return -1;
+  return macAddress[5];
+}
+
+static socklen_t socketAddress(int node, sockaddr_un& address) {
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  // abstract namespace, nothing is left behind on disk
+  const int len = snprintf(address.sun_path + 1, sizeof(address.sun_path) - 1, "autocc-%d-%d", (int)shared->groupPid, node);
+  return offsetof(sockaddr_un, sun_path) + 1 + len;
+}
+
+
+
+/* SETUP */
+
+void radioSetup(const structure_radio_config& config) {
+  if (shared == nullptr) {
+    void* mapped = mmap(nullptr, sizeof(structure_radio_shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) {
+      perror("radioSetup");
+      exit(1);
+    }
+    shared = new (mapped) structure_radio_shared();
+  }
+  shared->groupPid = getpid();
+  radioConfigure(config);
+  radioResetCounts();
+}
+
+void radioConfigure(const structure_radio_config& config) {
+  shared->latency = config.latency;
+  shared->jitter = config.jitter;
+  shared->lossPpm = config.loss * RADIO_PPM;
+  shared->reorderPpm = config.reorder * RADIO_PPM;
+}
+
+structure_radio_counts radioCounts() {
+  structure_radio_counts counts;
+  counts.numOfFrames = shared->numOfFrames;
+  counts.numOfBytes = shared->numOfBytes;
+  counts.numOfLost = shared->numOfLost;
+  counts.numOfUndelivered = shared->numOfUndelivered;
+  for (int f = 0; f < RADIO_MAX_FLAGS; f++) {
+    counts.numOfFlag[f] = shared->numOfFlag[f];
+  }
+  for (int r = 0; r < RADIO_MAX_REQUESTS; r++) {
+    counts.numOfRequest[r] = shared->numOfRequest[r];
+  }
+  return counts;
+}
+
+void radioResetCounts() {
+  shared->numOfFrames = 0;
+  shared->numOfBytes = 0;
+  shared->numOfLost = 0;
+  shared->numOfUndelivered = 0;
+  for (std::atomic<long>& count : shared->numOfFlag) {
+    count = 0;
+  }
+  for (std::atomic<long>& count : shared->numOfRequest) {
+    count = 0;
+  }
+}
+
+// counts the frame under its flag, and a FLAG_REQUEST under its request too
+static void countFrame(const uint8_t* data, int len) {
+  const int flag = frameFlag(data, len);
+  if (flag < 0 || flag >= RADIO_MAX_FLAGS) return;
+  shared->numOfFlag[flag]++;
+
+  structure_request request;
+  if (flag == FLAG_REQUEST && decodeRequest(data, len, request) && request.request >= 0 && request.request < RADIO_MAX_REQUESTS) {
+    shared->numOfRequest[request.request]++;
+  }
+}
+
+
+
+/* DEVICES */
+
+static void deliverFrames() {
+  structure_radio_device* self = device;
+  for (;;) {
+    structure_radio_frame frame;
+    {
+      std::unique_lock<std::mutex> guard(self->lock);
+      for (;;) {
+        if (self->queue.empty()) {
+          self->isQueued.wait(guard);
+          continue;
+        }
+        const unsigned long now = micros();
+        const unsigned long deliverAt = self->queue.begin()->first;
+        if ((long)(deliverAt - now) <= 0) break;
+        self->isQueued.wait_for(guard, std::chrono::microseconds(deliverAt - now));
+      }
+      frame = self->queue.begin()->second;
+      self->queue.erase(self->queue.begin());
+    }
+
+    esp_now_send_status_t status = ESP_NOW_SEND_FAIL;
+    if (frame.isLost) {
+      shared->numOfLost++;
+    } else if (frame.to < 0) {
+      shared->numOfUndelivered++;
+    } else {
+      sockaddr_un address;
+      const socklen_t len = socketAddress(frame.to, address);
+      if (sendto(self->socket, frame.data, frame.len, MSG_DONTWAIT, (sockaddr*)&address, len) == frame.len) {
+        status = ESP_NOW_SEND_SUCCESS;
+      } else {
+        shared->numOfUndelivered++; // not running, or its queue is full
+      }
+    }
+
+    esp_now_send_cb_t callback = self->sendCallback;
+    if (callback != nullptr) callback(frame.macAddress, status);
+  }
+}
+
+static void receiveFrames() {
+  structure_radio_device* self = device;
+  uint8_t data[6 + ESP_NOW_MAX_DATA_LEN];
+  byte ownMac[6];
+  radioMac(self->node, ownMac);
+
+  for (;;) {
+    const ssize_t len = recv(self->socket, data, sizeof(data), 0);
+    if (len < 6) continue;
+
+    esp_now_recv_cb_t callback = self->recvCallback;
+    if (callback == nullptr) continue; // ESP-NOW isn't listening yet
+    esp_now_recv_info_t info = {data, ownMac};
+    callback(&info, data + 6, len - 6);
+  }
+}
+
+void radioStart(int node) {
+  device->node = node;
+  device->random.seed(node * 7919 + getpid());
+  device->socket = socket(AF_UNIX, SOCK_DGRAM, 0);
+
+  sockaddr_un address;
+  const socklen_t len = socketAddress(node, address);
+  if (device->socket < 0 || bind(device->socket, (sockaddr*)&address, len) != 0) {
+    perror("radioStart");
+    exit(1);
+  }
+  const int bufferSize = 1 << 20;
+  setsockopt(device->socket, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+
+  std::thread(deliverFrames).detach();
+  std::thread(receiveFrames).detach();
+  shared->isListening[node] = true;
+}
+
+pid_t radioSpawn(int node, RadioDevice run, void* parameter) {
+  fflush(stdout);
+  const pid_t pid = fork();
+  if (pid < 0) {
+    perror("radioSpawn");
+    exit(1);
+  }
+  if (pid > 0) {
+    shared->pids[node] = pid;
+    return pid;
+  }
+
+  prctl(PR_SET_PDEATHSIG, SIGKILL); // never outlive the test
+  device = new structure_radio_device(); // the parent's may be mid use by a thread that wasn't forked
+  radioStart(node);
+  run(node, parameter);
+  fflush(stdout);
+  _exit(0);
+}
+
+bool radioIsListening(int node) {
+  return shared->isListening[node];
+}
+
+bool radioWaitForListening(int node, unsigned long timeout) {
+  const unsigned long startTime = millis();
+  while (!shared->isListening[node]) {
+    if (millis() - startTime >= timeout) return false;
+    delay(1);
+  }
+  return true;
+}
+
+// takes a spawned device off the air, as if it lost power
+void radioStop(int node) {
+  if (shared->pids[node] <= 0) return;
+  kill(shared->pids[node], SIGKILL);
+  waitpid(shared->pids[node], nullptr, 0);
+  shared->pids[node] = 0;
+  shared->isListening[node] = false;
+}
+
+void radioStopAll() {
+  for (int node = 0; node < RADIO_MAX_NODES; node++) {
+    radioStop(node);
+  }
+}
+
+
+
+/* ESP-NOW */
+
+esp_err_t esp_now_init() {
+  return (device->node < 0) ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t* peer) {
+  return (peer == nullptr) ? ESP_ERR_INVALID_ARG : ESP_OK;
+}
+
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t callback) {
+  device->sendCallback = callback;
+  return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t callback) {
+  device->recvCallback = callback;
+  return ESP_OK;
+}
+
+esp_err_t esp_now_send(const uint8_t* peer_addr, const uint8_t* data, size_t len) {
+  if (device->node < 0 || peer_addr == nullptr) return ESP_FAIL;
+  if (len == 0 || len > ESP_NOW_MAX_DATA_LEN) return ESP_ERR_INVALID_ARG;
+
+  structure_radio_frame frame;
+  frame.to = nodeFromMac(peer_addr);
+  memcpy(frame.macAddress, peer_addr, 6);
+  radioMac(device->node, frame.data);
+  memcpy(frame.data + 6, data, len);
+  frame.len = 6 + len;
+
+  shared->numOfFrames++;
+  shared->numOfBytes += len;
+  countFrame(data, len);
+
+  {
+    std::lock_guard<std::mutex> guard(device->lock);
+    const unsigned long latency = shared->latency;
+    const unsigned long jitter = shared->jitter;
+    std::uniform_int_distribution<uint32_t> ppm(0, RADIO_PPM - 1);
+    frame.isLost = ppm(device->random) < shared->lossPpm;
+
+    unsigned long wait = latency * 1000 + ((jitter > 0) ? device->random() % (jitter * 1000) : 0);
+    if (ppm(device->random) < shared->reorderPpm) {
+      wait += latency * 1000 + jitter * 1000 + 1000; // arrives after frames sent behind it
+    }
+    device->queue.insert({micros() + wait, frame});
+  }
+  device->isQueued.notify_one();
+  return ESP_OK;
+}
@@ -0,0 +1,68 @@
+/*
+  HostRadio.h
+
+  Andy Valentine - Valentine Autos
+
+  Simulated ESP-NOW radio for the host build. Each device is a process,
+  as each is its own chip on the car - the server and client classes
+  keep a static instance for their callbacks. Frames travel between
+  processes over local datagram sockets after a configurable latency
+  and jitter, and can be lost or held back so they arrive out of order.
+  Frame counts and the link settings live in memory shared by every
+  device, so the process running the server can measure and change them
+
+  Usage - radioSetup() once, radioSpawn() each client, then
+  radioStart(RADIO_SERVER_NODE) before the server's begin()
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#ifndef HostRadio_h
+#define HostRadio_h
+
+#include <Arduino.h>
+#include <sys/types.h>
+
+#define RADIO_MAX_NODES       64
+#define RADIO_SERVER_NODE     0
+#define RADIO_MAX_FLAGS       8     // FLAG_XXX frames are counted by flag
+#define RADIO_MAX_REQUESTS    16    // FLAG_REQUEST frames are also counted by REQUEST_XXX
+
+struct structure_radio_config {
+    unsigned long latency;     // ms every frame takes to arrive
+    unsigned long jitter;      // up to this many ms more, at random
+    double loss;               // share of frames that never arrive
+    double reorder;            // share of frames held back by another latency plus jitter
+};
+
+struct structure_radio_counts {
+    long numOfFrames;          // frames sent by any device
+    long numOfBytes;           // bytes in those frames
+    long numOfLost;            // frames the radio dropped
+    long numOfUndelivered;     // frames to a device that isn't running
+    long numOfFlag[RADIO_MAX_FLAGS];       // frames sent of each FLAG_XXX
+    long numOfRequest[RADIO_MAX_REQUESTS]; // FLAG_REQUEST frames sent of each REQUEST_XXX, requests and replies
+};
+
+// device to run in a spawned process, it never has to return
+typedef void (*RadioDevice)(int node, void* parameter);
+
+// call once, before any device is spawned or started
+void radioSetup(const structure_radio_config& config);
+void radioConfigure(const structure_radio_config& config);
+
+// forks a process that starts the radio as node, then runs device in it
+pid_t radioSpawn(int node, RadioDevice device, void* parameter);
+void radioStart(int node);
+bool radioIsListening(int node);
+bool radioWaitForListening(int node, unsigned long timeout);
+void radioStop(int node);
+void radioStopAll();
+
+// device node has MAC address 02:00:00:00:00:node
+void radioMac(int node, byte macAddress[6]);
+structure_radio_counts radioCounts();
+void radioResetCounts();
+
+#endif
@@ -0,0 +1,356 @@
+/*
+  HostShim.cpp
+
+  Andy Valentine - Valentine Autos
+
+  Host versions of the Arduino, FreeRTOS, NVS and Preferences calls
+  the library makes
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <WiFi.h>
+#include <nvs_flash.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* TIME */
+
+static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+unsigned long millis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+unsigned long micros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void delay(unsigned long ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+uint32_t esp_random() {
+  static std::mutex lock;
+  static std::mt19937 generator(std::random_device{}());
+  std::lock_guard<std::mutex> guard(lock);
+  return generator();
+}
+
+
+
+/* SERIAL */
+
+static std::atomic<bool> isSerialEnabled{false};
+
+void hostSerial(bool isEnabled) {
+  isSerialEnabled = isEnabled;
+}
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  size_t written = 0;
+  for (size_t i = 0; i < size; i++) {
+    written += write(buffer[i]);
+  }
+  return written;
+}
+
+size_t Print::printf(const char* format, ...) {
+  char text[256];
+  va_list args;
+  va_start(args, format);
+  const int len = vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  if (len <= 0) return 0;
+  return write((const uint8_t*)text, std::min((size_t)len, sizeof(text) - 1));
+}
+
+size_t Print::print(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+size_t Print::print(char c) { return write((uint8_t)c); }
+size_t Print::print(int number) { return printf("%d", number); }
+size_t Print::print(unsigned int number) { return printf("%u", number); }
+size_t Print::print(long number) { return printf("%ld", number); }
+size_t Print::print(unsigned long number) { return printf("%lu", number); }
+size_t Print::print(double number) { return printf("%.2f", number); }
+size_t Print::println() { return print("\r\n"); }
+size_t Print::println(const char* text) { return print(text) + println(); }
+size_t Print::println(int number) { return print(number) + println(); }
+size_t Print::println(unsigned int number) { return print(number) + println(); }
+size_t Print::println(long number) { return print(number) + println(); }
+size_t Print::println(unsigned long number) { return print(number) + println(); }
+size_t Print::println(double number) { return print(number) + println(); }
+
+void HardwareSerial::begin(unsigned long) {}
+
+size_t HardwareSerial::write(uint8_t c) {
+  if (isSerialEnabled && c != '\r') fputc(c, stdout);
+  return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  if (isSerialEnabled) {
+    for (size_t i = 0; i < size; i++) {
+      if (buffer[i] != '\r') fputc(buffer[i], stdout);
+    }
+  }
+  return size;
+}
+
+HardwareSerial Serial;
+WiFiClass WiFi;
+
+
+
+/* TASKS */
+
+// a task's handle is its notification counter
+struct structure_notification {
+    std::mutex lock;
+    std::condition_variable isGiven;
+    uint32_t count = 0;
+};
+
+static thread_local structure_notification* currentNotification = nullptr;
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  if (currentNotification == nullptr) {
+    currentNotification = new structure_notification(); // lives as long as the process, handles may outlive the thread
+  }
+  return currentNotification;
+}
+
+void xTaskNotifyGive(TaskHandle_t task) {
+  structure_notification* notification = static_cast<structure_notification*>(task);
+  if (notification == nullptr) return;
+  std::lock_guard<std::mutex> guard(notification->lock);
+  notification->count++;
+  notification->isGiven.notify_all();
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait) {
+  structure_notification* notification = static_cast<structure_notification*>(xTaskGetCurrentTaskHandle());
+  std::unique_lock<std::mutex> guard(notification->lock);
+  auto isGiven = [notification] { return notification->count > 0; };
+  if (ticksToWait == portMAX_DELAY) {
+    notification->isGiven.wait(guard, isGiven);
+  } else {
+    notification->isGiven.wait_for(guard, std::chrono::milliseconds(ticksToWait * portTICK_PERIOD_MS), isGiven);
+  }
+
+  const uint32_t count = notification->count;
+  if (clearOnExit) {
+    notification->count = 0;
+  } else if (count > 0) {
+    notification->count--;
+  }
+  return count;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char*, uint32_t, void* parameter, UBaseType_t, TaskHandle_t* handle) {
+  std::mutex lock;
+  std::condition_variable isStarted;
+  TaskHandle_t created = nullptr;
+
+  std::thread([&lock, &isStarted, &created, task, parameter] {
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      created = self;
+      isStarted.notify_all();
+    }
+    task(parameter);
+  }).detach();
+
+  std::unique_lock<std::mutex> guard(lock);
+  isStarted.wait(guard, [&created] { return created != nullptr; });
+  if (handle != nullptr) *handle = created;
+  return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char* name, uint32_t stackSize, void* parameter, UBaseType_t priority, TaskHandle_t* handle, BaseType_t) {
+  return xTaskCreate(task, name, stackSize, parameter, priority, handle);
+}
+
+void vTaskDelay(TickType_t ticks) {
+  delay(ticks * portTICK_PERIOD_MS);
+}
+
+void taskYIELD() {
+  std::this_thread::yield();
+}
+
+
+
+/* CRITICAL SECTIONS */
+
+static unsigned long threadNumber() {
+  static std::atomic<unsigned long> nextNumber{1};
+  static thread_local unsigned long number = nextNumber++;
+  return number;
+}
+
+void vPortEnterCritical(portMUX_TYPE* mux) {
+  const unsigned long self = threadNumber();
+  if (mux->owner.load(std::memory_order_acquire) == self) {
+    mux->count++;
+    return;
+  }
+
+  unsigned long expected = 0;
+  while (!mux->owner.compare_exchange_weak(expected, self, std::memory_order_acquire)) {
+    expected = 0;
+    std::this_thread::yield();
+  }
+  mux->count = 1;
+}
+
+void vPortExitCritical(portMUX_TYPE* mux) {
+  if (--mux->count == 0) {
+    mux->owner.store(0, std::memory_order_release);
+  }
+}
+
+
+
+/* NVS AND PREFERENCES */
+
+// flash for both, keyed by namespace and key
+static std::mutex flashLock;
+static std::map<std::string, std::vector<uint8_t>>& flash() {
+  static std::map<std::string, std::vector<uint8_t>> contents;
+  return contents;
+}
+static std::vector<std::string> nvsNames;
+static std::atomic<unsigned long> numOfCommits{0};
+
+esp_err_t nvs_flash_init() {
+  return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase() {
+  std::lock_guard<std::mutex> guard(flashLock);
+  flash().clear();
+  return ESP_OK;
+}
+
+esp_err_t nvs_open(const char* name, nvs_open_mode_t, nvs_handle_t* handle) {
+  std::lock_guard<std::mutex> guard(flashLock);
+  nvsNames.push_back(std::string("nvs/") + name + "/");
+  *handle = nvsNames.size() - 1;
+  return ESP_OK;
+}
+
+esp_err_t nvs_get_i32(nvs_handle_t handle, const char* key, int32_t* value) {
+  std::lock_guard<std::mutex> guard(flashLock);
+  if (handle >= nvsNames.size()) return ESP_ERR_INVALID_ARG;
+  auto it = flash().find(nvsNames[handle] + key);
+  if (it == flash().end() || it->second.size() != sizeof(int32_t)) return ESP_ERR_NVS_NOT_FOUND;
+  memcpy(value, it->second.data(), sizeof(int32_t));
+  return ESP_OK;
+}
+
+esp_err_t nvs_set_i32(nvs_handle_t handle, const char* key, int32_t value) {
+  std::lock_guard<std::mutex> guard(flashLock);
+  if (handle >= nvsNames.size()) return ESP_ERR_INVALID_ARG;
+  std::vector<uint8_t>& stored = flash()[nvsNames[handle] + key];
+  stored.resize(sizeof(int32_t));
+  memcpy(stored.data(), &value, sizeof(int32_t));
+  return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t) {
+  numOfCommits++;
+  return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t) {}
+
+unsigned long hostNumOfCommits() {
+  return numOfCommits;
+}
+
+bool Preferences::begin(const char* name, bool readOnly) {
+  _name = name;
+  _isOpen = true;
+  _isReadOnly = readOnly;
+  return true;
+}
+
+void Preferences::end() {
+  _isOpen = false;
+}
+
+std::string Preferences::path(const char* key) const {
+  return "prefs/" + _name + "/" + key;
+}
+
+bool Preferences::isKey(const char* key) {
+  std::lock_guard<std::mutex> guard(flashLock);
+  return _isOpen && flash().count(path(key)) > 0;
+}
+
+bool Preferences::remove(const char* key) {
+  std::lock_guard<std::mutex> guard(flashLock);
+  return _isOpen && !_isReadOnly && flash().erase(path(key)) > 0;
+}
+
+bool Preferences::clear() {
+  std::lock_guard<std::mutex> guard(flashLock);
+  if (!_isOpen || _isReadOnly) return false;
+  const std::string prefix = path("");
+  for (auto it = flash().begin(); it != flash().end();) {
+    it = (it->first.compare(0, prefix.size(), prefix) == 0) ? flash().erase(it) : std::next(it);
+  }
+  return true;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t len) {
+  std::lock_guard<std::mutex> guard(flashLock);
+  if (!_isOpen || _isReadOnly) return 0;
+  const uint8_t* bytes = static_cast<const uint8_t*>(value);
+  flash()[path(key)] = std::vector<uint8_t>(bytes, bytes + len);
+  return len;
+}
+
+size_t Preferences::getBytes(const char* key, void* buffer, size_t maxLen) {
+  std::lock_guard<std::mutex> guard(flashLock);
+  auto it = flash().find(path(key));
+  if (!_isOpen || it == flash().end() || it->second.size() > maxLen) return 0;
+  memcpy(buffer, it->second.data(), it->second.size());
+  return it->second.size();
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+  std::lock_guard<std::mutex> guard(flashLock);
+  auto it = flash().find(path(key));
+  return (!_isOpen || it == flash().end()) ? 0 : it->second.size();
+}
+
+size_t Preferences::putUInt(const char* key, uint32_t value) {
+  return putBytes(key, &value, sizeof(value));
+}
+
+uint32_t Preferences::getUInt(const char* key, uint32_t defaultValue) {
+  uint32_t value = defaultValue;
+  return (getBytes(key, &value, sizeof(value)) == sizeof(value)) ? value : defaultValue;
+}
+
+size_t Preferences::putInt(const char* key, int32_t value) {
+  return putBytes(key, &value, sizeof(value));
+}
+
+int32_t Preferences::getInt(const char* key, int32_t defaultValue) {
+  int32_t value = defaultValue;
+  return (getBytes(key, &value, sizeof(value)) == sizeof(value)) ? value : defaultValue;
+}
@@ -0,0 +1,42 @@
+/*
+  Preferences.h
+
+  Andy Valentine - Valentine Autos
+
+  Host shim of the Preferences key value store, held in memory for the
+  life of the process so a second server instance sees what the first saved
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#ifndef Preferences_h
+#define Preferences_h
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class Preferences {
+  public:
+    bool begin(const char* name, bool readOnly = false);
+    void end();
+    bool isKey(const char* key);
+    bool remove(const char* key);
+    bool clear();
+    size_t putBytes(const char* key, const void* value, size_t len);
+    size_t getBytes(const char* key, void* buffer, size_t maxLen);
+    size_t getBytesLength(const char* key);
+    size_t putUInt(const char* key, uint32_t value);
+    uint32_t getUInt(const char* key, uint32_t defaultValue = 0);
+    size_t putInt(const char* key, int32_t value);
+    int32_t getInt(const char* key, int32_t defaultValue = 0);
+  private:
+    std::string _name;
+    bool _isOpen = false;
+    bool _isReadOnly = false;
+
+    std::string path(const char* key) const;
+};
+
+#endif
@@ -0,0 +1,30 @@
+/*
+  WiFi.h
+
+  Andy Valentine - Valentine Autos
+
+  Host shim of the WiFi mode switch, there is no station to join
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#ifndef WiFi_h
+#define WiFi_h
+
+#define WIFI_OFF              0
+#define WIFI_STA              1
+#define WIFI_AP               2
+#define WIFI_AP_STA           3
+
+class WiFiClass {
+  public:
+    bool mode(int mode) { _mode = mode; return true; }
+    int getMode() const { return _mode; }
+  private:
+    int _mode = WIFI_OFF;
+};
+
+extern WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,48 @@
+/*
+  esp_now.h
+
+  Andy Valentine - Valentine Autos
+
+  Host shim of ESP-NOW, carried by the simulated radio in HostRadio.h
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#ifndef esp_now_h
+#define esp_now_h
+
+#include <cstddef>
+#include <cstdint>
+#include "esp_err.h"
+
+#define ESP_NOW_MAX_DATA_LEN  250
+#define ESP_NOW_ETH_ALEN      6
+
+typedef enum {
+  ESP_NOW_SEND_SUCCESS = 0,
+  ESP_NOW_SEND_FAIL
+} esp_now_send_status_t;
+
+typedef struct {
+  uint8_t peer_addr[ESP_NOW_ETH_ALEN];
+  uint8_t channel;
+  int ifidx;
+  bool encrypt;
+} esp_now_peer_info_t;
+
+typedef struct esp_now_recv_info {
+  uint8_t* src_addr;
+  uint8_t* des_addr;
+} esp_now_recv_info_t;
+
+typedef void (*esp_now_send_cb_t)(const uint8_t* mac_addr, esp_now_send_status_t status);
+typedef void (*esp_now_recv_cb_t)(const esp_now_recv_info_t* recvInfo, const uint8_t* data, int len);
+
+esp_err_t esp_now_init();
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t* peer);
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t callback);
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t callback);
+esp_err_t esp_now_send(const uint8_t* peer_addr, const uint8_t* data, size_t len);
+
+#endif
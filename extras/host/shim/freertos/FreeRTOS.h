@@ -0,0 +1,45 @@
+/*
+  freertos/FreeRTOS.h
+
+  Andy Valentine - Valentine Autos
+
+  Host shim of the FreeRTOS types and critical sections. A portMUX is a
+  spinlock that the owning thread can take again, as on the ESP32
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#ifndef FreeRTOS_h
+#define FreeRTOS_h
+
+#include <atomic>
+#include <cstdint>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE               0
+#define pdTRUE                1
+#define pdPASS                1
+#define portMAX_DELAY         0xffffffffUL
+#define portTICK_PERIOD_MS    1
+#define pdMS_TO_TICKS(ms)     ((TickType_t)(ms))
+
+struct portMUX_TYPE {
+    std::atomic<unsigned long> owner;  // id of the thread holding it, 0 if free
+    int count;                         // times the owner has taken it
+};
+
+#define portMUX_INITIALIZER_UNLOCKED {}
+
+void vPortEnterCritical(portMUX_TYPE* mux);
+void vPortExitCritical(portMUX_TYPE* mux);
+
+#define portENTER_CRITICAL(mux)       vPortEnterCritical(mux)
+#define portEXIT_CRITICAL(mux)        vPortExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux)   vPortEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux)    vPortExitCritical(mux)
+
+#endif
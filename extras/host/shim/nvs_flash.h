@@ -0,0 +1,20 @@
+/*
+  nvs_flash.h
+
+  Andy Valentine - Valentine Autos
+
+  Host shim of the NVS partition setup
+  
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#ifndef nvs_flash_h
+#define nvs_flash_h
+
+#include "nvs.h"
+
+esp_err_t nvs_flash_init();
+esp_err_t nvs_flash_erase();
+
+#endif
@@ -0,0 +1,137 @@
+/*
+  AutoCCSim.cpp
+
+  Andy Valentine - Valentine Autos
+
+  Runs a server against a fleet of simulated clients and reports how
+  long discovery takes, the round trip of setValue and the frames each
+  part of the protocol costs. Exits with 1 if anything goes missing, so
+  a run doubles as a regression test
+
+    autocc_sim --clients 20 --options 30 --latency 2 --jitter 3 --loss 0.1 --reorder 0.05
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include <algorithm>
+#include <vector>
+#include "AutoCCServer.h"
+#include "HostFleet.h"
+
+struct structure_sim_config {
+    structure_fleet_config fleet;
+    structure_radio_config radio;
+    int numOfSets;             // setValue calls timed
+    bool isVerbose;            // library logging to stdout
+};
+
+static bool readArgs(int argc, char** argv, structure_sim_config& config) {
+  config.fleet = {20, 30, 0.0};
+  config.radio = {2, 0, 0.0, 0.0};
+  config.numOfSets = 200;
+  config.isVerbose = false;
+
+  for (int a = 1; a < argc; a++) {
+    const char* name = argv[a];
+    const char* value = (a + 1 < argc) ? argv[a + 1] : nullptr;
+    if (strcmp(name, "--verbose") == 0) {
+      config.isVerbose = true;
+      continue;
+    }
+    if (value == nullptr) return false;
+    a++;
+
+    if (strcmp(name, "--clients") == 0)       config.fleet.numOfClients = atoi(value);
+    else if (strcmp(name, "--options") == 0)  config.fleet.numOfOptions = atoi(value);
+    else if (strcmp(name, "--offline") == 0)  config.fleet.offlineShare = atof(value);
+    else if (strcmp(name, "--latency") == 0)  config.radio.latency = atol(value);
+    else if (strcmp(name, "--jitter") == 0)   config.radio.jitter = atol(value);
+    else if (strcmp(name, "--loss") == 0)     config.radio.loss = atof(value);
+    else if (strcmp(name, "--reorder") == 0)  config.radio.reorder = atof(value);
+    else if (strcmp(name, "--sets") == 0)     config.numOfSets = atoi(value);
+    else return false;
+  }
+  return config.fleet.numOfClients > 0 && config.fleet.numOfClients <= FLEET_MAX_CLIENTS && config.fleet.numOfOptions > 0;
+}
+
+static unsigned long percentile(std::vector<unsigned long>& samples, int percent) {
+  if (samples.empty()) return 0;
+  std::sort(samples.begin(), samples.end());
+  return samples[std::min(samples.size() - 1, samples.size() * percent / 100)];
+}
+
+int main(int argc, char** argv) {
+  structure_sim_config config;
+  if (!readArgs(argc, argv, config)) {
+    fprintf(stderr, "usage: autocc_sim [--clients n] [--options n] [--offline share] [--latency ms] [--jitter ms] [--loss share] [--reorder share] [--sets n] [--verbose]\n");
+    return 2;
+  }
+  hostSerial(config.isVerbose);
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+
+  printf("clients %d offline %.2f options %d latency %lu jitter %lu loss %.2f reorder %.2f\n",
+    config.fleet.numOfClients, config.fleet.offlineShare, config.fleet.numOfOptions,
+    config.radio.latency, config.radio.jitter, config.radio.loss, config.radio.reorder);
+
+  radioSetup(config.radio);
+  std::vector<structure_peer> peers(config.fleet.numOfClients);
+  const int numOfOnline = fleetSpawn(config.fleet, peers.data());
+  radioStart(RADIO_SERVER_NODE);
+
+  int numOfFailures = 0;
+  AutoCCServer server;
+
+  // discovery - probing every client and downloading every menu
+  radioResetCounts();
+  unsigned long startTime = millis();
+  server.begin(peers.data(), config.fleet.numOfClients);
+  const unsigned long discoveryMs = elapsedMs(startTime);
+  structure_radio_counts counts = radioCounts();
+  const int numOfExpected = numOfOnline * config.fleet.numOfOptions;
+  printf("discovery_ms %lu items %d expected %d frames %ld bytes %ld\n", discoveryMs, server.numOfMenuItems, numOfExpected, counts.numOfFrames, counts.numOfBytes);
+  if (server.numOfMenuItems != numOfExpected) numOfFailures++;
+
+  // setValue round trips, spread over every item
+  std::vector<unsigned long> roundTrips;
+  int numOfFailedSets = 0;
+  radioResetCounts();
+  for (int s = 0; s < config.numOfSets && !server.menuItems.empty(); s++) {
+    const structure_option& item = server.menuItems[(s * 7919) % server.menuItems.size()];
+    startTime = micros();
+    if (server.setValue(item.uniqueId, (item.value + 1) % 1000)) {
+      roundTrips.push_back(elapsedUs(startTime));
+    } else {
+      numOfFailedSets++;
+    }
+    server.poll();
+  }
+  counts = radioCounts();
+  const int numOfSets = roundTrips.size() + numOfFailedSets;
+  printf("set_value_us p50 %lu p90 %lu p99 %lu max %lu sets %d failed %d frames_per_set %.2f\n",
+    percentile(roundTrips, 50), percentile(roundTrips, 90), percentile(roundTrips, 99), percentile(roundTrips, 100),
+    numOfSets, numOfFailedSets, numOfSets ? (double)counts.numOfFrames / numOfSets : 0.0);
+  numOfFailures += numOfFailedSets;
+
+  // one setValues across every online client, SET_VALUES_MAX values each
+  std::vector<structure_value_update> updates;
+  for (size_t slot = 0; slot < server.menuItems.size(); slot++) {
+    if (slot % config.fleet.numOfOptions < SET_VALUES_MAX) {
+      updates.push_back({server.menuItems[slot].uniqueId, (int)slot % 1000, false});
+    }
+  }
+  radioResetCounts();
+  startTime = millis();
+  const int numOfSet = server.setValues(updates.data(), updates.size());
+  counts = radioCounts();
+  printf("set_values_ms %lu set %d of %d frames %ld\n", elapsedMs(startTime), numOfSet, (int)updates.size(), counts.numOfFrames);
+  if (numOfSet != (int)updates.size()) numOfFailures++;
+
+  structure_metrics metrics;
+  server.getMetrics(metrics);
+  printf("duplicates %u dropped %u queue_high_water %d\n", metrics.numOfDuplicates, metrics.numOfDroppedFrames, metrics.queueHighWaterMark);
+
+  radioStopAll();
+  printf("%s\n", numOfFailures ? "FAILED" : "OK");
+  return numOfFailures ? 1 : 0;
+}
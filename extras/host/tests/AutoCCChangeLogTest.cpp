@@ -0,0 +1,90 @@
+/*
+  AutoCCChangeLogTest.cpp
+
+  Andy Valentine - Valentine Autos
+
+  Changes come back oldest first with consecutive sequence numbers, a
+  page at a time, until the sequence a UI last saw has dropped out of
+  the ring or the menu has changed shape, when it has to fetch the
+  whole menu again
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include "AutoCC.h"
+#include "AutoCCChangeLog.h"
+#include "HostTest.h"
+
+#define TEST_PAGE             5     // changes copied per call when paging
+
+// the count changes after seq are seq + 1 onwards, in order, each from addChanges
+static void checkRun(const structure_change* changes, int count, unsigned long seq) {
+  for (int n = 0; n < count; n++) {
+    check(changes[n].seq == seq + 1 + n);
+    check(changes[n].uniqueId == 1000 + changes[n].seq);
+    check(changes[n].value == (int)changes[n].seq * 3);
+    check(changes[n].kind == CHANGE_VALUE);
+  }
+}
+
+static void addChanges(AutoCCChangeLog& log, int numOfChanges) {
+  for (int n = 0; n < numOfChanges; n++) {
+    const unsigned long seq = log.sequence() + 1;
+    check(log.add(1000 + seq, (int)seq * 3, CHANGE_VALUE) == seq);
+  }
+}
+
+int main() {
+  AutoCCChangeLog log;
+  structure_change changes[CHANGE_LOG_SIZE + 1];
+
+  // nothing since the start, and nothing from a sequence not yet reached
+  const unsigned long start = log.sequence();
+  check(log.since(start, changes, CHANGE_LOG_SIZE) == 0);
+  check(log.since(start + 1, changes, CHANGE_LOG_SIZE) == -1);
+
+  addChanges(log, 12);
+  check(log.since(start, changes, CHANGE_LOG_SIZE) == 12);
+  checkRun(changes, 12, start);
+
+  // paging on from the last change copied misses none out
+  unsigned long seen = start;
+  int numOfPaged = 0;
+  int count;
+  while ((count = log.since(seen, changes, TEST_PAGE)) > 0) {
+    check(count <= TEST_PAGE);
+    checkRun(changes, count, seen);
+    seen = changes[count - 1].seq;
+    numOfPaged += count;
+  }
+  check(count == 0);
+  check(numOfPaged == 12);
+  check(seen == log.sequence());
+
+  // wrapping the ring drops the oldest, and a sequence before them needs the whole menu
+  addChanges(log, CHANGE_LOG_SIZE * 2 + 3);
+  const unsigned long latest = log.sequence();
+  check(log.since(start, changes, CHANGE_LOG_SIZE) == -1);
+  check(log.since(latest - CHANGE_LOG_SIZE - 1, changes, CHANGE_LOG_SIZE) == -1);
+  check(log.since(latest - CHANGE_LOG_SIZE, changes, CHANGE_LOG_SIZE + 1) == CHANGE_LOG_SIZE);
+  checkRun(changes, CHANGE_LOG_SIZE, latest - CHANGE_LOG_SIZE);
+  check(log.since(latest - 3, changes, CHANGE_LOG_SIZE) == 3);
+  checkRun(changes, 3, latest - 3);
+
+  // a client coming or going is logged alongside the values
+  const unsigned long online = log.add(7, ONLINE, CHANGE_CLIENT);
+  check(log.since(online - 1, changes, CHANGE_LOG_SIZE) == 1);
+  check(changes[0].kind == CHANGE_CLIENT && changes[0].uniqueId == 7 && changes[0].value == ONLINE);
+
+  // once the menu changes shape, only changes after that are held
+  const unsigned long snapshot = log.invalidate();
+  check(snapshot == online + 1);
+  check(log.since(online, changes, CHANGE_LOG_SIZE) == -1);
+  check(log.since(snapshot, changes, CHANGE_LOG_SIZE) == 0);
+  addChanges(log, 2);
+  check(log.since(snapshot, changes, CHANGE_LOG_SIZE) == 2);
+  checkRun(changes, 2, snapshot);
+
+  return testResult();
+}
@@ -0,0 +1,143 @@
+/*
+  AutoCCCodecTest.cpp
+
+  Andy Valentine - Valentine Autos
+
+  Requests and options survive an encode and decode unchanged, truncated
+  frames and frames from another protocol version are rejected, and the
+  packed frames are at most half the size of the structs they carry
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include "AutoCCCodec.h"
+#include "HostTest.h"
+
+static bool isSameRequest(const structure_request& a, const structure_request& b) {
+  return a.uniqueId == b.uniqueId && a.request == b.request && a.value == b.value && a.fingerprint == b.fingerprint;
+}
+
+static bool isSameOption(const structure_option& a, const structure_option& b) {
+  return a.uniqueId == b.uniqueId && a.clientId == b.clientId && a.type == b.type
+    && a.rangeMin == b.rangeMin && a.rangeMax == b.rangeMax && a.value == b.value
+    && strcmp(a.memId, b.memId) == 0 && strcmp(a.label, b.label) == 0;
+}
+
+static structure_option makeOption(unsigned long uniqueId, int type, int rangeMin, int rangeMax, int value, const char* memId, const char* label) {
+  structure_option option = {};
+  option.flag       = FLAG_OPTION;
+  option.uniqueId   = uniqueId;
+  option.clientId   = 7;
+  option.type       = type;
+  option.rangeMin   = rangeMin;
+  option.rangeMax   = rangeMax;
+  option.value      = value;
+  strcpy(option.memId, memId);
+  strcpy(option.label, label);
+  return option;
+}
+
+static void testRequests() {
+  const structure_request requests[] = {
+    {FLAG_REQUEST, 0, REQUEST_AWAKE, 0, 0},
+    {FLAG_REQUEST, 123456, REQUEST_SET_VALUE, 512, 0},
+    {FLAG_REQUEST, 0xFFFFFFFF, REQUEST_COUNT, -1, 0xDEADBEEF},
+    {FLAG_REQUEST, 42, REQUEST_SET_VALUES, INT32_MIN, 1},
+    {FLAG_REQUEST, 99, REQUEST_VALUE_CHANGED, INT32_MAX, 0},
+  };
+
+  for (const structure_request& request : requests) {
+    uint8_t frame[MAX_FRAME_SIZE];
+    const int len = encodeRequest(frame, sizeof(frame), request);
+    check(len > 0);
+    check(frameFlag(frame, len) == FLAG_REQUEST);
+
+    structure_request decoded = {};
+    check(decodeRequest(frame, len, decoded) == len);
+    check(isSameRequest(request, decoded));
+
+    for (int cut = 0; cut < len; cut++) {
+      check(decodeRequest(frame, cut, decoded) == 0);
+    }
+  }
+
+  // a typical setValue request against the struct it replaces
+  uint8_t frame[MAX_FRAME_SIZE];
+  check(encodeRequest(frame, sizeof(frame), requests[1]) * 2 <= (int)sizeof(structure_request));
+}
+
+static void testOptions() {
+  const structure_option options[] = {
+    makeOption(1000, TYPE_SWITCH, 0, 1, 1, "drlstate", "DRL"),
+    makeOption(1001, TYPE_RANGE, -40, 125, -12, "oiltemp", "Oil temperature"),
+    makeOption(0xFFFFFFFF, TYPE_TELEMETRY, INT32_MIN, INT32_MAX, 0, "abcdefghijkl", "0123456789012345678901234567890"),
+    makeOption(5, TYPE_RANGE, 0, 1000, 1000, "", ""),
+  };
+
+  for (const structure_option& option : options) {
+    uint8_t frame[MAX_FRAME_SIZE];
+    const int len = encodeOption(frame, sizeof(frame), option);
+    check(len > 0);
+    check(frameFlag(frame, len) == FLAG_OPTION);
+
+    structure_option decoded = {};
+    check(decodeOption(frame, len, decoded) == len);
+    check(isSameOption(option, decoded));
+
+    for (int cut = 0; cut < len; cut++) {
+      check(decodeOption(frame, cut, decoded) == 0);
+    }
+  }
+
+  // a typical option against the struct that used to be copied on air
+  uint8_t frame[MAX_FRAME_SIZE];
+  check(encodeOption(frame, sizeof(frame), options[1]) * 2 <= (int)sizeof(structure_option));
+}
+
+static void testVersionAndFlag() {
+  uint8_t frame[MAX_FRAME_SIZE];
+  const structure_request request = {FLAG_REQUEST, 10, REQUEST_AWAKE, 1, 0};
+  const int len = encodeRequest(frame, sizeof(frame), request);
+  structure_request decoded;
+  structure_option option;
+
+  // an option decoder doesn't take a request
+  check(decodeOption(frame, len, option) == 0);
+
+  frame[0] = ((PROTOCOL_VERSION + 1) << 4) | FLAG_REQUEST;
+  check(frameFlag(frame, len) == -1);
+  check(frameSeq(frame, len) == -1);
+  check(decodeRequest(frame, len, decoded) == 0);
+}
+
+static void testSeq() {
+  uint8_t frame[MAX_FRAME_SIZE];
+  const structure_request request = {FLAG_REQUEST, 10, REQUEST_AWAKE, 1, 0};
+  const int len = encodeRequest(frame, sizeof(frame), request);
+  stampSeq(frame, 0xBEEF);
+  check(frameSeq(frame, len) == 0xBEEF);
+
+  structure_request decoded;
+  check(decodeRequest(frame, len, decoded) == len);
+  check(isSameRequest(request, decoded));
+}
+
+// too small a buffer fails the encode rather than writing past it
+static void testOverflow() {
+  const structure_option option = makeOption(1001, TYPE_RANGE, -40, 125, -12, "oiltemp", "Oil temperature");
+  uint8_t frame[MAX_FRAME_SIZE];
+  const int len = encodeOption(frame, sizeof(frame), option);
+  for (int size = 0; size < len; size++) {
+    check(encodeOption(frame, size, option) == 0);
+  }
+}
+
+int main() {
+  testRequests();
+  testOptions();
+  testVersionAndFlag();
+  testSeq();
+  testOverflow();
+  return testResult();
+}
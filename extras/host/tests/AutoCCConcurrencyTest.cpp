@@ -0,0 +1,159 @@
+/*
+  AutoCCConcurrencyTest.cpp
+
+  Andy Valentine - Valentine Autos
+
+  Runs the request table and the receive queue with their producer and
+  consumer on separate threads, as the WiFi task and the task calling
+  the library use them, and checks nothing is lost, duplicated or torn
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include <atomic>
+#include <random>
+#include <thread>
+#include "AutoCCReceiveQueue.h"
+#include "AutoCCRequestTable.h"
+#include "HostTest.h"
+
+#define TABLE_REQUESTS        200000
+#define TABLE_WINDOW          48    // requests in flight at once
+#define QUEUE_FRAMES          500000
+
+/* The requesting thread lists a window of requests and takes each once
+it's answered, while the receiving thread answers them in a random order
+and a third reads the table as poll() would
+*/
+static void stressRequestTable() {
+  AutoCCRequestTable table;
+  std::atomic<unsigned long> windowStart{0};
+  std::atomic<unsigned long> windowEnd{0};
+  std::atomic<bool> isDone{false};
+  std::atomic<long> numOfCompleted{0};
+  std::atomic<long> numOfOverfull{0};        // reads seeing more than a window in flight
+  long numOfTaken = 0;
+  long numOfWrongValues = 0;
+
+  std::thread receiver([&] {
+    std::mt19937 random(1);
+    structure_pending_request pending;
+    while (!isDone) {
+      const unsigned long start = windowStart;
+      const unsigned long end = windowEnd;
+      if (end <= start) continue;
+      const unsigned long uniqueId = start + random() % (end - start);
+      if (table.complete(uniqueId, REQUEST_SET_VALUE, (int)uniqueId, pending)) {
+        numOfCompleted++;
+      }
+      std::this_thread::yield();
+    }
+  });
+
+  std::thread reader([&] {
+    structure_pending_request pending;
+    while (!isDone) {
+      table.timeUntilNextRetry(millis(), REQUEST_RETRY_INTERVAL);
+      table.takeRetry(millis(), pending);
+      if (table.count() > TABLE_WINDOW) numOfOverfull++;
+      std::this_thread::yield();
+    }
+  });
+
+  structure_pending_request pending = {};
+  pending.request = REQUEST_SET_VALUE;
+  pending.retryAt = millis();
+  for (unsigned long start = 1; start <= TABLE_REQUESTS; start += TABLE_WINDOW) {
+    const unsigned long end = start + TABLE_WINDOW;
+    for (unsigned long uniqueId = start; uniqueId < end; uniqueId++) {
+      pending.uniqueId = uniqueId;
+      check(table.add(pending));
+    }
+    windowEnd = end;
+    windowStart = start;
+
+    for (unsigned long uniqueId = start; uniqueId < end; uniqueId++) {
+      structure_pending_request taken;
+      while (!table.takeCompleted(uniqueId, REQUEST_SET_VALUE, taken)) {
+        std::this_thread::yield();
+      }
+      numOfTaken++;
+      if (taken.value != (int)uniqueId) numOfWrongValues++;
+    }
+  }
+  isDone = true;
+  receiver.join();
+  reader.join();
+
+  const long numOfRequests = ((TABLE_REQUESTS + TABLE_WINDOW - 1) / TABLE_WINDOW) * TABLE_WINDOW;
+  check(numOfTaken == numOfRequests);
+  check(numOfCompleted == numOfRequests);
+  check(numOfWrongValues == 0);
+  check(numOfOverfull == 0);
+  check(table.count() == 0);
+}
+
+// frame n carries n in its first four bytes, and n + k in byte k after them
+static int fillFrame(uint8_t* data, uint32_t n) {
+  const int len = 4 + n % (MAX_FRAME_SIZE - 4);
+  memcpy(data, &n, 4);
+  for (int k = 4; k < len; k++) {
+    data[k] = (uint8_t)(n + k);
+  }
+  return len;
+}
+
+static bool isFrameIntact(const structure_frame& frame, uint32_t n) {
+  uint8_t expected[MAX_FRAME_SIZE];
+  const int len = fillFrame(expected, n);
+  return frame.len == len && memcmp(frame.data, expected, len) == 0 && frame.macAddress[5] == (uint8_t)n;
+}
+
+/* The receive callback's thread pushes numbered frames, pushing again
+when the queue is full, while the draining thread checks each arrives
+once, in order and whole
+*/
+static void stressReceiveQueue() {
+  AutoCCReceiveQueue queue;
+  long numOfFull = 0;
+
+  std::thread producer([&] {
+    uint8_t data[MAX_FRAME_SIZE];
+    byte macAddress[6] = {0x02, 0, 0, 0, 0, 0};
+    for (uint32_t n = 0; n < QUEUE_FRAMES; n++) {
+      const int len = fillFrame(data, n);
+      macAddress[5] = (uint8_t)n;
+      while (!queue.push(macAddress, data, len)) {
+        numOfFull++;
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  long numOfReceived = 0;
+  long numOfBroken = 0;
+  while (numOfReceived < QUEUE_FRAMES) {
+    structure_frame* frame = queue.front();
+    if (frame == nullptr) {
+      std::this_thread::yield();
+      continue;
+    }
+    if (!isFrameIntact(*frame, numOfReceived)) numOfBroken++;
+    queue.pop();
+    numOfReceived++;
+  }
+  producer.join();
+
+  check(numOfBroken == 0);
+  check(queue.front() == nullptr);
+  check(queue.size() == 0);
+  check((long)queue.numOfDropped() == numOfFull);
+  check(queue.highWaterMark() <= RECEIVE_QUEUE_SIZE);
+}
+
+int main() {
+  stressRequestTable();
+  stressReceiveQueue();
+  return testResult();
+}
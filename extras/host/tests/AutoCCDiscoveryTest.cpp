@@ -0,0 +1,113 @@
+/*
+  AutoCCDiscoveryTest.cpp
+
+  Andy Valentine - Valentine Autos
+
+  Discovery keeps option requests in flight to every client at once, so
+  a fleet's menus download in a handful of round trips rather than one
+  round trip per option. A server booting again with the menus in its
+  cache only asks each client for its values
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include <map>
+#include <string>
+#include "AutoCCServer.h"
+#include "HostFleet.h"
+#include "HostTest.h"
+
+#define TEST_CLIENTS          5
+#define TEST_OPTIONS          30
+#define TEST_LATENCY          10    // ms each way, so a round trip is 20 ms
+#define TEST_MAX_ROUND_TRIPS  15    // one request at a time would take over TEST_CLIENTS * TEST_OPTIONS
+#define TEST_CHANGED_VALUE    777   // set between the boots, so the cached value is stale
+
+// uniqueId of each item by label, which is unique across the fleet
+static std::map<std::string, unsigned long> idsByLabel(AutoCCServer& server) {
+  std::map<std::string, unsigned long> ids;
+  for (const structure_option& item : server.menuItems) {
+    ids[item.label] = item.uniqueId;
+  }
+  return ids;
+}
+
+// option j of every client has its client's first id + j, the block the client numbers its options in
+static bool hasClientOrderIds(std::map<std::string, unsigned long>& ids) {
+  for (int k = 1; k <= TEST_CLIENTS; k++) {
+    const unsigned long baseId = ids["Client " + std::to_string(k) + " option 0"];
+    for (int j = 0; j < TEST_OPTIONS; j++) {
+      if (ids["Client " + std::to_string(k) + " option " + std::to_string(j)] != baseId + j) return false;
+    }
+  }
+  return true;
+}
+
+int main() {
+  radioSetup({TEST_LATENCY, 0, 0.0, 0.0});
+  structure_fleet_config fleet = {TEST_CLIENTS, TEST_OPTIONS, 0.0};
+  structure_peer peers[TEST_CLIENTS];
+  fleetSpawn(fleet, peers);
+  radioStart(RADIO_SERVER_NODE);
+
+  // first boot downloads every option, and caches the menus
+  AutoCCServer server;
+  unsigned long startTime = millis();
+  server.begin(peers, TEST_CLIENTS);
+  const unsigned long discoveryMs = elapsedMs(startTime);
+  structure_radio_counts counts = radioCounts();
+  printf("discovery_ms %lu frames %ld\n", discoveryMs, counts.numOfFrames);
+
+  check(server.numOfMenuItems == TEST_CLIENTS * TEST_OPTIONS);
+  check(discoveryMs < TEST_MAX_ROUND_TRIPS * 2 * TEST_LATENCY);
+  check(counts.numOfFrames < TEST_CLIENTS * TEST_OPTIONS); // fewer than one per option
+
+  std::map<std::string, unsigned long> firstIds = idsByLabel(server);
+  check(hasClientOrderIds(firstIds));
+  const structure_option changed = server.menuItems[0];
+  check(server.setValue(changed.uniqueId, TEST_CHANGED_VALUE));
+
+  /* a second server stands in for the first rebooting with the same flash,
+  the first is left alive so the radio's callbacks never see it freed */
+  radioResetCounts();
+  AutoCCServer rebooted;
+  startTime = millis();
+  rebooted.begin(peers, TEST_CLIENTS);
+  const unsigned long warmMs = elapsedMs(startTime);
+  counts = radioCounts();
+  printf("warm_boot_ms %lu frames %ld\n", warmMs, counts.numOfFrames);
+
+  check(rebooted.numOfMenuItems == TEST_CLIENTS * TEST_OPTIONS);
+  check(counts.numOfFlag[FLAG_OPTION] == 0);
+  check(counts.numOfFlag[FLAG_OPTION_BATCH] == 0);
+  check(counts.numOfRequest[REQUEST_OPTION] == 0);
+  check(counts.numOfRequest[REQUEST_OPTION_BATCH] == 0);
+
+  // a probe, then ALLOCATE_ID, COUNT and one VALUE_BATCH, each answered
+  check(counts.numOfRequest[REQUEST_AWAKE] == 2 * TEST_CLIENTS);
+  check(counts.numOfRequest[REQUEST_ALLOCATE_ID] == 2 * TEST_CLIENTS);
+  check(counts.numOfRequest[REQUEST_COUNT] == 2 * TEST_CLIENTS);
+  check(counts.numOfRequest[REQUEST_VALUE_BATCH] == TEST_CLIENTS);
+  check(counts.numOfFlag[FLAG_VALUE_BATCH] == TEST_CLIENTS);
+  check(counts.numOfFrames == 8 * TEST_CLIENTS);
+
+  // every item comes back under the same label and memId, in the same id
+  // block layout, with the value the client holds rather than the cached one
+  std::map<std::string, unsigned long> warmIds = idsByLabel(rebooted);
+  check(warmIds.size() == firstIds.size());
+  check(hasClientOrderIds(warmIds));
+  for (const structure_option& item : rebooted.menuItems) {
+    const bool isChanged = strcmp(item.label, changed.label) == 0;
+    check(firstIds.count(item.label) == 1);
+    check(item.value == (isChanged ? TEST_CHANGED_VALUE : atoi(strrchr(item.label, ' ') + 1)));
+  }
+
+  // the clients took the same ids, so each answers a set through them
+  for (const structure_option& item : rebooted.menuItems) {
+    check(rebooted.setValue(item.uniqueId, 1));
+  }
+
+  radioStopAll();
+  return testResult();
+}
@@ -0,0 +1,64 @@
+/*
+  AutoCCLatencyTest.cpp
+
+  Andy Valentine - Valentine Autos
+
+  setValue returns as soon as the client's reply arrives, so its latency
+  follows the radio's round trip rather than any polling interval. Prints
+  a histogram of the round trips and checks its tail
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include <algorithm>
+#include <vector>
+#include "AutoCCServer.h"
+#include "HostFleet.h"
+#include "HostTest.h"
+
+#define TEST_LATENCY          3     // ms each way
+#define TEST_SETS             200
+#define TEST_BUCKET_MS        1     // histogram bucket width
+
+int main() {
+  radioSetup({TEST_LATENCY, 0, 0.0, 0.0});
+  structure_fleet_config fleet = {1, 10, 0.0};
+  structure_peer peers[1];
+  fleetSpawn(fleet, peers);
+  radioStart(RADIO_SERVER_NODE);
+
+  AutoCCServer server;
+  server.begin(peers, 1);
+  check(server.numOfMenuItems == 10);
+
+  std::vector<unsigned long> roundTrips;
+  for (int s = 0; s < TEST_SETS && server.numOfMenuItems > 0; s++) {
+    const structure_option& item = server.menuItems[s % server.numOfMenuItems];
+    const unsigned long startTime = micros();
+    check(server.setValue(item.uniqueId, (item.value + 1) % 1000));
+    roundTrips.push_back(elapsedUs(startTime));
+  }
+  std::sort(roundTrips.begin(), roundTrips.end());
+
+  std::vector<int> buckets;
+  for (unsigned long roundTrip : roundTrips) {
+    const size_t bucket = roundTrip / (TEST_BUCKET_MS * 1000);
+    if (bucket >= buckets.size()) buckets.resize(bucket + 1, 0);
+    buckets[bucket]++;
+  }
+  for (size_t bucket = 0; bucket < buckets.size(); bucket++) {
+    if (buckets[bucket] > 0) printf("%3zu ms %d\n", bucket * TEST_BUCKET_MS, buckets[bucket]);
+  }
+
+  const unsigned long roundTripUs = 2 * TEST_LATENCY * 1000;
+  const unsigned long p50 = roundTrips[roundTrips.size() / 2];
+  const unsigned long p99 = roundTrips[roundTrips.size() * 99 / 100];
+  printf("p50 %lu us p99 %lu us\n", p50, p99);
+  check(roundTrips.front() >= roundTripUs);
+  check(p50 < 2 * roundTripUs);
+  check(p99 < REQUEST_RETRY_INTERVAL * 1000); // never waits on a resend, let alone a timeout
+
+  radioStopAll();
+  return testResult();
+}
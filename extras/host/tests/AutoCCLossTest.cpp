@@ -0,0 +1,110 @@
+/*
+  AutoCCLossTest.cpp
+
+  Andy Valentine - Valentine Autos
+
+  With 10% to 20% of frames lost, discovery and all but the rarest
+  setValue still succeed, and resends keep setValue's tail to a few resend intervals
+  rather than a timeout. An item whose owner is unknown is refused without
+  a frame, rather than sent to every client where each resend would be
+  applied again. Takes the share of frames lost, 0.2 by default
+
+    AutoCCLossTest 0.1
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include <algorithm>
+#include <vector>
+#include "AutoCCServer.h"
+#include "HostFleet.h"
+#include "HostTest.h"
+
+#define TEST_LOSS             0.2
+#define TEST_CLIENTS          5
+#define TEST_OPTIONS          30
+#define TEST_SETS             200
+#define TEST_MAX_FAILED       1     // at 20% loss a round trip fails one time in three, so all ten sends fail about once in 30000 sets
+#define TEST_MAX_P95          (4 * REQUEST_RETRY_INTERVAL) // ms, three resends of the request or its reply
+
+/* Hands the server an option from a client it doesn't know, as a reply
+to a listed REQUEST_OPTION, so the item has no owner. Returns its uniqueId
+*/
+static unsigned long addUnownedItem(AutoCCServer& server) {
+  structure_option option = {};
+  option.flag = FLAG_OPTION;
+  strcpy(option.memId, "unowned");
+  strcpy(option.label, "Unowned option");
+  option.type = TYPE_RANGE;
+  option.rangeMax = 1000;
+  option.uniqueId = generateUniqueId();
+  option.clientId = 0;
+
+  structure_pending_request pending = {};
+  pending.uniqueId = option.uniqueId;
+  pending.request = REQUEST_OPTION;
+  pending.clientIndex = -1;
+  pending.numOfSends = REQUEST_MAX_SENDS;
+  pending.deadline = millis() + REQUEST_TIMEOUT;
+  server.requestList.add(pending);
+
+  byte macAddress[6];
+  radioMac(RADIO_MAX_NODES - 1, macAddress);
+  uint8_t frame[MAX_FRAME_SIZE];
+  server.receiveQueue.push(macAddress, frame, encodeOption(frame, sizeof(frame), option));
+  server.poll();
+  server.requestList.remove(option.uniqueId, REQUEST_OPTION);
+  return option.uniqueId;
+}
+
+int main(int argc, char** argv) {
+  const double loss = (argc > 1) ? atof(argv[1]) : TEST_LOSS;
+  radioSetup({2, 2, loss, 0.0});
+  structure_fleet_config fleet = {TEST_CLIENTS, TEST_OPTIONS, 0.0};
+  structure_peer peers[TEST_CLIENTS];
+  fleetSpawn(fleet, peers);
+  radioStart(RADIO_SERVER_NODE);
+
+  AutoCCServer server;
+  server.begin(peers, TEST_CLIENTS);
+  check(server.numOfMenuItems == TEST_CLIENTS * TEST_OPTIONS);
+
+  std::vector<unsigned long> roundTrips;
+  int numOfFailed = 0;
+  for (int s = 0; s < TEST_SETS && server.numOfMenuItems > 0; s++) {
+    const structure_option& item = server.menuItems[(s * 7919) % server.numOfMenuItems];
+    const unsigned long startTime = millis();
+    if (server.setValue(item.uniqueId, (item.value + 1) % 1000)) {
+      roundTrips.push_back(elapsedMs(startTime));
+    } else {
+      numOfFailed++;
+    }
+    server.poll();
+  }
+  std::sort(roundTrips.begin(), roundTrips.end());
+
+  const unsigned long p50 = roundTrips.empty() ? 0 : roundTrips[roundTrips.size() / 2];
+  const unsigned long p95 = roundTrips.empty() ? 0 : roundTrips[roundTrips.size() * 95 / 100];
+  const unsigned long p99 = roundTrips.empty() ? 0 : roundTrips[roundTrips.size() * 99 / 100];
+  const structure_radio_counts counts = radioCounts();
+  printf("loss %.2f lost %ld of %ld frames, set_value_ms p50 %lu p95 %lu p99 %lu failed %d\n",
+    loss, counts.numOfLost, counts.numOfFrames, p50, p95, p99, numOfFailed);
+
+  check(numOfFailed <= TEST_MAX_FAILED);
+  check(p95 < TEST_MAX_P95);
+  check(counts.numOfLost > 0);
+
+  const unsigned long unownedId = addUnownedItem(server);
+  check(server.numOfMenuItems == TEST_CLIENTS * TEST_OPTIONS + 1);
+  radioResetCounts();
+  const unsigned long startTime = millis();
+  check(!server.setValue(unownedId, 1));
+  check(server.setValueAsync(unownedId, 1) == 0);
+  check(elapsedMs(startTime) < REQUEST_RETRY_INTERVAL);
+  check(radioCounts().numOfFrames == 0);
+  check(server.requestList.count() == 0);
+
+  radioStopAll();
+  return testResult();
+}
@@ -0,0 +1,159 @@
+/*
+  AutoCCMenuJsonTest.cpp
+
+  Andy Valentine - Valentine Autos
+
+  The menu written in chunks, however small the buffer, joins up to the
+  same JSON the Print overload writes in one go, with labels that need
+  every kind of escaping. The menu version only moves when a value
+  really changes
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include <string>
+#include "AutoCCClient.h"
+#include "AutoCCLog.h"
+#include "AutoCCServer.h"
+#include "HostFleet.h"
+#include "HostTest.h"
+
+#define TEST_OPTIONS          24
+#define TEST_LABEL_LEN        31    // longest label, leaving room for the terminator
+
+// collects everything printed to it
+class StringPrint : public Print {
+  public:
+    std::string text;
+    size_t write(uint8_t c) override {
+      text += (char)c;
+      return 1;
+    }
+};
+
+/* option j has a plain label, or one of nothing but quotes, backslashes
+or control characters, so the longest items need the most escaping
+*/
+static void runEscapingClient(int node, void*) {
+  structure_peer server[1];
+  fleetServerPeer(server[0]);
+
+  static structure_option_setup options[TEST_OPTIONS];
+  for (int j = 0; j < TEST_OPTIONS; j++) {
+    snprintf(options[j].id, sizeof(options[j].id), "opt%d", j);
+    if (j % 4 == 0) {
+      snprintf(options[j].label, sizeof(options[j].label), "Plain option %d", j);
+    } else {
+      const char fill = (j % 4 == 1) ? '"' : (j % 4 == 2) ? '\\' : (char)(1 + j % 31);
+      memset(options[j].label, fill, TEST_LABEL_LEN);
+      options[j].label[TEST_LABEL_LEN] = '\0';
+    }
+    options[j].type = TYPE_RANGE;
+    options[j].rangeMin = -100000 * j;
+    options[j].rangeMax = 100000 * j;
+    options[j].value = -j;
+  }
+
+  AutoCCClient* client = new AutoCCClient();
+  client->begin(server, options, TEST_OPTIONS);
+  for (;;) {
+    flushLog();
+    delay(10);
+  }
+}
+
+// writes the menu in chunks of at most size, joined up
+static std::string writeChunked(AutoCCServer& server, int size) {
+  std::string joined;
+  char* buffer = new char[size];
+  structure_menu_cursor cursor = {};
+  int len;
+  int numOfChunks = 0;
+  while ((len = server.writeMenuJson(buffer, size, cursor)) > 0) {
+    check(len <= size);
+    joined.append(buffer, len);
+    numOfChunks++;
+  }
+  check(len == 0);
+  check(cursor.isFinished);
+  check(server.writeMenuJson(buffer, size, cursor) == 0);
+  delete[] buffer;
+  printf("chunk_size %d chunks %d\n", size, numOfChunks);
+  return joined;
+}
+
+static void checkChunks(AutoCCServer& server) {
+  StringPrint whole;
+  const size_t written = server.writeMenuJson(whole);
+  check(written == whole.text.size());
+  check(whole.text.front() == '[' && whole.text.back() == ']');
+
+  // each label comes out escaped, with nothing left raw
+  check(whole.text.find("\"Plain option 0\"") != std::string::npos);
+  check(whole.text.find(std::string(TEST_LABEL_LEN * 2, '\\')) != std::string::npos);
+  check(whole.text.find("\\u0004\\u0004") != std::string::npos);
+  for (char c : whole.text) {
+    check((uint8_t)c >= 0x20);
+  }
+
+  const int sizes[] = {MENU_JSON_ITEM_SIZE, MENU_JSON_ITEM_SIZE + 1, MENU_JSON_ITEM_SIZE * 2 - 1, 4096};
+  for (int size : sizes) {
+    check(writeChunked(server, size) == whole.text);
+  }
+
+  // a buffer that can't hold the longest item is refused rather than written short
+  char small[MENU_JSON_ITEM_SIZE - 1];
+  structure_menu_cursor cursor = {};
+  check(server.writeMenuJson(small, sizeof(small), cursor) == -1);
+}
+
+static void checkVersion(AutoCCServer& server) {
+  const structure_option item = server.menuItems[1];
+  const unsigned long version = server.menuVersion();
+  check(server.changesSince(version, nullptr, 0) == 0);
+
+  // setting the value it already has isn't a change
+  check(server.setValue(item.uniqueId, item.value));
+  check(server.menuVersion() == version);
+
+  check(server.setValue(item.uniqueId, item.value + 7));
+  check(server.menuVersion() == version + 1);
+
+  structure_change changes[4];
+  check(server.changesSince(version, changes, 4) == 1);
+  check(changes[0].seq == version + 1);
+  check(changes[0].uniqueId == item.uniqueId);
+  check(changes[0].value == item.value + 7);
+  check(changes[0].kind == CHANGE_VALUE);
+
+  StringPrint whole;
+  server.writeMenuJson(whole);
+  char expected[64];
+  snprintf(expected, sizeof(expected), "\"value\":%d}", item.value + 7);
+  check(whole.text.find(expected) != std::string::npos);
+}
+
+int main() {
+  radioSetup({2, 0, 0.0, 0.0});
+  structure_peer peers[1];
+  snprintf(peers[0].label, sizeof(peers[0].label), "Client 1");
+  radioMac(1, peers[0].macAddress);
+  radioSpawn(1, runEscapingClient, nullptr);
+  radioWaitForListening(1, 5000);
+  radioStart(RADIO_SERVER_NODE);
+
+  AutoCCServer server;
+  server.begin(peers, 1);
+  check(server.numOfMenuItems == TEST_OPTIONS);
+  if (server.numOfMenuItems != TEST_OPTIONS) {
+    radioStopAll();
+    return testResult();
+  }
+
+  checkChunks(server);
+  checkVersion(server);
+
+  radioStopAll();
+  return testResult();
+}
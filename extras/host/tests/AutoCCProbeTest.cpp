@@ -0,0 +1,143 @@
+/*
+  AutoCCProbeTest.cpp
+
+  Andy Valentine - Valentine Autos
+
+  Every client is probed at once against one shared deadline, so however
+  many clients are offline a sweep costs a single REQUEST_TIMEOUT. A
+  client that falls silent is probed and marked offline, then probed
+  less and less often, and one booting after the server is found through
+  its own announce. Built against autocc_host_fast, so the liveness
+  timings are scaled down from the defaults
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include <algorithm>
+#include "AutoCCServer.h"
+#include "HostFleet.h"
+#include "HostTest.h"
+
+#define TEST_CLIENTS          10
+#define TEST_OFFLINE_SHARE    0.5   // one at a time, the offline half alone would take 5 timeouts
+#define TEST_BACKOFF_PROBES   5     // failed probes watched once the silent client is offline
+#define TEST_MARGIN           150   // ms allowed for scheduling on a loaded host
+
+/* Stops an online client and polls until it's marked offline, then
+records the gap before each further probe. The first gap is
+PROBE_BACKOFF_MIN and each failed probe doubles it, up to PROBE_BACKOFF_MAX
+*/
+static void checkSilentClient(AutoCCServer& server, int silentIndex, int otherIndex) {
+  radioStop(silentIndex + 1);
+  structure_online_client& client = server.onlineClients[silentIndex];
+
+  unsigned long startTime = millis();
+  while (client.isOnline && elapsedMs(startTime) < SILENCE_THRESHOLD + REQUEST_TIMEOUT * 4) {
+    server.poll();
+    delay(1);
+  }
+  const unsigned long offlineAt = millis();
+  check(client.isOnline == OFFLINE);
+
+  // probed once the silence threshold passed, then marked offline at the probe's deadline
+  const unsigned long silentMs = offlineAt - client.lastSeen;
+  printf("silent_ms %lu\n", silentMs);
+  check(silentMs >= SILENCE_THRESHOLD + REQUEST_TIMEOUT);
+  check(silentMs < SILENCE_THRESHOLD + REQUEST_TIMEOUT + TEST_MARGIN);
+
+  unsigned long backoffs[TEST_BACKOFF_PROBES];
+  unsigned long gaps[TEST_BACKOFF_PROBES];
+  int numOfBackoffs = 0;
+  unsigned long nextProbe = client.nextProbe;
+  backoffs[numOfBackoffs] = client.probeBackoff;
+  gaps[numOfBackoffs++] = nextProbe - offlineAt;
+
+  startTime = millis();
+  const unsigned long timeout = TEST_BACKOFF_PROBES * (PROBE_BACKOFF_MAX + REQUEST_TIMEOUT) * 2;
+  while (numOfBackoffs < TEST_BACKOFF_PROBES && elapsedMs(startTime) < timeout) {
+    server.poll();
+    if (client.nextProbe != nextProbe) {
+      nextProbe = client.nextProbe;
+      backoffs[numOfBackoffs] = client.probeBackoff;
+      gaps[numOfBackoffs++] = nextProbe - millis();
+    }
+    delay(1);
+  }
+  check(numOfBackoffs == TEST_BACKOFF_PROBES);
+
+  unsigned long expected = PROBE_BACKOFF_MIN;
+  for (int n = 0; n < numOfBackoffs; n++) {
+    printf("probe %d backoff_ms %lu\n", n, backoffs[n]);
+    check(backoffs[n] == expected);
+    check(gaps[n] <= backoffs[n] && gaps[n] + TEST_MARGIN > backoffs[n]);
+    expected = std::min(expected * 2, (unsigned long)PROBE_BACKOFF_MAX);
+  }
+  check(backoffs[numOfBackoffs - 1] == PROBE_BACKOFF_MAX);
+
+  // the client still answering keeps being found online
+  check(client.isOnline == OFFLINE);
+  check(server.onlineClients[otherIndex].isOnline == ONLINE);
+}
+
+/* Starts a client the server has only ever seen offline. Its next probe
+is pushed out of reach, so only the client's announce can bring it in,
+without a checkAwakeStatus
+*/
+static void checkLateClient(AutoCCServer& server, const structure_fleet_config& fleet, int lateIndex) {
+  structure_online_client& client = server.onlineClients[lateIndex];
+  check(client.isOnline == OFFLINE);
+  check(client.numOfOptions == 0);
+  client.nextProbe = millis() + 60000;
+  const int numOfMenuItems = server.numOfMenuItems;
+
+  check(fleetStartClient(fleet, lateIndex));
+  const unsigned long startTime = millis();
+  while (server.numOfMenuItems < numOfMenuItems + fleet.numOfOptions && elapsedMs(startTime) < REQUEST_TIMEOUT * 4) {
+    server.poll();
+    delay(1);
+  }
+  const unsigned long announceMs = elapsedMs(startTime);
+  printf("announce_ms %lu\n", announceMs);
+
+  check(client.isOnline == ONLINE);
+  check(client.numOfOptions == fleet.numOfOptions);
+  check(server.numOfMenuItems == numOfMenuItems + fleet.numOfOptions);
+  check(announceMs < REQUEST_TIMEOUT);
+}
+
+int main() {
+  radioSetup({2, 0, 0.0, 0.0});
+  structure_fleet_config fleet = {TEST_CLIENTS, 5, TEST_OFFLINE_SHARE};
+  structure_peer peers[TEST_CLIENTS];
+  const int numOfOnline = fleetSpawn(fleet, peers);
+  radioStart(RADIO_SERVER_NODE);
+  check(numOfOnline == TEST_CLIENTS / 2);
+
+  AutoCCServer server;
+  unsigned long startTime = millis();
+  server.begin(peers, TEST_CLIENTS);
+  const unsigned long beginMs = elapsedMs(startTime);
+
+  startTime = millis();
+  server.checkAwakeStatus();
+  const unsigned long sweepMs = elapsedMs(startTime);
+  printf("begin_ms %lu sweep_ms %lu\n", beginMs, sweepMs);
+
+  check(server.numOfOnlineClients == TEST_CLIENTS);
+  for (int i = 0; i < server.numOfOnlineClients; i++) {
+    check(server.onlineClients[i].isOnline == fleetIsOnline(fleet, i));
+  }
+  check(server.numOfMenuItems == numOfOnline * fleet.numOfOptions);
+
+  // the offline clients run the probe to its deadline, and no further
+  check(sweepMs >= REQUEST_TIMEOUT);
+  check(sweepMs < REQUEST_TIMEOUT * 3 / 2);
+  check(beginMs < REQUEST_TIMEOUT * 3 / 2);
+
+  checkSilentClient(server, 0, 2);
+  checkLateClient(server, fleet, 1);
+
+  radioStopAll();
+  return testResult();
+}
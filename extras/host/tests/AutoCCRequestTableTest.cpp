@@ -0,0 +1,64 @@
+/*
+  AutoCCRequestTableTest.cpp
+
+  Andy Valentine - Valentine Autos
+
+  Requests are keyed by unique id and request type, so a reply only ever
+  answers a request of its own type, even when an item's id is reused
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include "AutoCC.h"
+#include "AutoCCRequestTable.h"
+#include "HostTest.h"
+
+static structure_pending_request pendingRequest(unsigned long uniqueId, int request, int value) {
+  structure_pending_request pending = {};
+  pending.uniqueId    = uniqueId;
+  pending.request     = request;
+  pending.clientIndex = 0;
+  pending.sentValue   = value;
+  return pending;
+}
+
+int main() {
+  AutoCCRequestTable table;
+  structure_pending_request pending;
+
+  // one id waiting on two kinds of request, as a menu's base id does
+  check(table.add(pendingRequest(1000, REQUEST_COUNT, 0)));
+  check(table.add(pendingRequest(1000, REQUEST_OPTION_BATCH, 0)));
+  check(!table.add(pendingRequest(1000, REQUEST_COUNT, 0)));
+  check(table.count() == 2);
+
+  // a reply of another type answers nothing
+  check(!table.complete(1000, REQUEST_SET_VALUE, 7, pending));
+  check(!table.takeCompleted(1000, REQUEST_COUNT, pending));
+
+  check(table.complete(1000, REQUEST_OPTION_BATCH, 12, pending));
+  check(pending.request == REQUEST_OPTION_BATCH);
+  check(!table.takeCompleted(1000, REQUEST_COUNT, pending));
+  check(table.takeCompleted(1000, REQUEST_OPTION_BATCH, pending));
+  check(pending.value == 12);
+
+  check(table.contains(1000, REQUEST_COUNT));
+  check(!table.contains(1000, REQUEST_OPTION_BATCH));
+  check(table.find(1000, REQUEST_COUNT, pending) && !pending.isComplete);
+
+  // ids colliding on a home slot still find their own entries once one is erased
+  for (unsigned long id = 1; id <= 40; id++) {
+    check(table.add(pendingRequest(id, REQUEST_SET_VALUE, id)));
+  }
+  for (unsigned long id = 1; id <= 40; id += 2) {
+    check(table.remove(id, REQUEST_SET_VALUE));
+  }
+  for (unsigned long id = 2; id <= 40; id += 2) {
+    check(table.find(id, REQUEST_SET_VALUE, pending) && pending.sentValue == (int)id);
+  }
+  check(table.remove(1000, REQUEST_COUNT));
+  check(table.count() == 20);
+
+  return testResult();
+}
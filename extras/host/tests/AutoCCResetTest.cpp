@@ -0,0 +1,61 @@
+/*
+  AutoCCResetTest.cpp
+
+  Andy Valentine - Valentine Autos
+
+  resetClients starts again from a new client list, so a reordered list
+  rebuilds the menu once, with every item owned by, and set through, the
+  client it came from
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include "AutoCCServer.h"
+#include "HostFleet.h"
+#include "HostTest.h"
+
+#define TEST_CLIENTS          3
+#define TEST_OPTIONS          5
+
+static int numOfFailedCallbacks = 0;
+
+static void onSet(unsigned long, bool success, int) {
+  if (!success) numOfFailedCallbacks++;
+}
+
+int main() {
+  radioSetup({2, 0, 0.0, 0.0});
+  structure_fleet_config fleet = {TEST_CLIENTS, TEST_OPTIONS, 0.0};
+  structure_peer peers[TEST_CLIENTS];
+  fleetSpawn(fleet, peers);
+  radioStart(RADIO_SERVER_NODE);
+
+  AutoCCServer server;
+  server.begin(peers, TEST_CLIENTS);
+  check(server.numOfMenuItems == TEST_CLIENTS * TEST_OPTIONS);
+
+  // left in flight across the reset, it fails rather than being lost
+  check(server.setValueAsync(server.menuItems[0].uniqueId, 500, onSet) != 0);
+
+  structure_peer reversed[TEST_CLIENTS];
+  for (int k = 0; k < TEST_CLIENTS; k++) {
+    reversed[k] = peers[TEST_CLIENTS - 1 - k];
+  }
+  server.resetClients(reversed);
+  check(numOfFailedCallbacks == 1);
+  check(server.requestList.count() == 0);
+
+  check(server.numOfOnlineClients == TEST_CLIENTS);
+  check(strcmp(server.onlineClients[0].label, peers[TEST_CLIENTS - 1].label) == 0);
+  check(server.numOfMenuItems == TEST_CLIENTS * TEST_OPTIONS);
+  check((int)server.menuItems.size() == server.numOfMenuItems);
+
+  // a set only succeeds if it reaches the client owning the item
+  for (int slot = 0; slot < server.numOfMenuItems; slot++) {
+    check(server.setValue(server.menuItems[slot].uniqueId, 100 + slot));
+  }
+
+  radioStopAll();
+  return testResult();
+}
@@ -0,0 +1,57 @@
+/*
+  AutoCCSceneFramesTest.cpp
+
+  Andy Valentine - Valentine Autos
+
+  A 15 option scene on one client is applied in a single round trip -
+  one FLAG_SET_VALUES frame out and one reply back
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include "AutoCCServer.h"
+#include "HostFleet.h"
+#include "HostTest.h"
+
+#define TEST_OPTIONS          15
+
+int main() {
+  radioSetup({2, 0, 0.0, 0.0});
+  structure_fleet_config fleet = {1, TEST_OPTIONS, 0.0};
+  structure_peer peers[1];
+  fleetSpawn(fleet, peers);
+  radioStart(RADIO_SERVER_NODE);
+
+  AutoCCServer server;
+  server.begin(peers, 1);
+  check(server.numOfMenuItems == TEST_OPTIONS);
+
+  structure_value_update updates[TEST_OPTIONS];
+  for (int slot = 0; slot < TEST_OPTIONS; slot++) {
+    updates[slot] = {server.menuItems[slot].uniqueId, 100 + slot, false};
+  }
+
+  delay(100); // lets anything left from discovery settle
+  radioResetCounts();
+  check(server.setValues(updates, TEST_OPTIONS) == TEST_OPTIONS);
+  check(radioCounts().numOfFrames == 2);
+  for (int slot = 0; slot < TEST_OPTIONS; slot++) {
+    check(updates[slot].isSet);
+    check(server.menuItems[slot].value == 100 + slot);
+  }
+
+  for (int slot = 0; slot < TEST_OPTIONS; slot++) {
+    updates[slot].value = 200 + slot;
+  }
+  check(server.saveScene("evening", updates, TEST_OPTIONS));
+  radioResetCounts();
+  check(server.applyScene("evening") == TEST_OPTIONS);
+  check(radioCounts().numOfFrames == 2);
+  for (int slot = 0; slot < TEST_OPTIONS; slot++) {
+    check(server.menuItems[slot].value == 200 + slot);
+  }
+
+  radioStopAll();
+  return testResult();
+}
@@ -0,0 +1,67 @@
+/*
+  AutoCCSupersedeTest.cpp
+
+  Andy Valentine - Valentine Autos
+
+  A setValueAsync that replaces one still in flight for the same item
+  must still fire the first request's callback, with success false, and
+  the reply to the first must not be taken as the reply to the second
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include "AutoCCServer.h"
+#include "HostFleet.h"
+#include "HostTest.h"
+
+struct structure_result {
+    int numOfCalls;
+    bool success;
+    int value;
+};
+
+static structure_result results[2];
+
+static void firstDone(unsigned long, bool success, int value) {
+  results[0] = {results[0].numOfCalls + 1, success, value};
+}
+
+static void secondDone(unsigned long, bool success, int value) {
+  results[1] = {results[1].numOfCalls + 1, success, value};
+}
+
+int main() {
+  radioSetup({2, 0, 0.0, 0.0});
+  structure_fleet_config fleet = {1, 5, 0.0};
+  structure_peer peers[1];
+  fleetSpawn(fleet, peers);
+  radioStart(RADIO_SERVER_NODE);
+
+  AutoCCServer server;
+  server.begin(peers, 1);
+  check(server.numOfMenuItems == 5);
+
+  const unsigned long uniqueId = server.menuItems[2].uniqueId;
+  check(server.setValueAsync(uniqueId, 100, firstDone) == uniqueId);
+  check(server.setValueAsync(uniqueId, 200, secondDone) == uniqueId);
+
+  // the first is finished by the second, before any reply could be handled
+  check(results[0].numOfCalls == 1);
+  check(!results[0].success);
+
+  const unsigned long startTime = millis();
+  while (results[1].numOfCalls == 0 && millis() - startTime < 2 * REQUEST_TIMEOUT) {
+    server.poll();
+    delay(1);
+  }
+  check(results[0].numOfCalls == 1);
+  check(results[1].numOfCalls == 1);
+  check(results[1].success);
+  check(results[1].value == 200);
+  check(server.menuItems[2].value == 200);
+  check(!server.isBusy());
+
+  radioStopAll();
+  return testResult();
+}
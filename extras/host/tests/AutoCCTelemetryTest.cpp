@@ -0,0 +1,107 @@
+/*
+  AutoCCTelemetryTest.cpp
+
+  Andy Valentine - Valentine Autos
+
+  Samples a client publishes for its TYPE_TELEMETRY options stream to the
+  server in FLAG_STREAM frames, land in each option's ring in the order
+  they were published, and leave the menu version alone
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include "AutoCCClient.h"
+#include "AutoCCLog.h"
+#include "AutoCCServer.h"
+#include "HostFleet.h"
+#include "HostTest.h"
+
+#define TEST_SAMPLES          20    // published for each telemetry option
+#define TEST_INTERVAL         (2 * STREAM_INTERVAL) // ms between samples, so none are coalesced
+#define TEST_TEMP_BASE        100   // sample n of "temp" is this + n
+#define TEST_RPM_BASE         2000  // sample n of "rpm" is this + 10n
+#define TEST_TRIGGER          2     // option the server sets once it has the menu
+
+// publishes both telemetry options once the server sets the trigger
+static void runPublishingClient(int node, void*) {
+  structure_peer server[1];
+  fleetServerPeer(server[0]);
+
+  structure_option_setup options[3] = {
+    {"temp", "Coolant temperature", TYPE_TELEMETRY, 0, 0, 0},
+    {"rpm", "Engine speed", TYPE_TELEMETRY, 0, 0, 0},
+    {"trigger", "Start publishing", TYPE_SWITCH, 0, 0, 0},
+  };
+
+  AutoCCClient* client = new AutoCCClient();
+  client->begin(server, options, 3);
+  while (client->options[TEST_TRIGGER].value != 1) {
+    delay(1);
+  }
+
+  const structure_option_handle temp = client->getHandle("temp");
+  const structure_option_handle rpm = client->getHandle("rpm");
+  for (int n = 0; n < TEST_SAMPLES; n++) {
+    client->publish(temp, TEST_TEMP_BASE + n);
+    client->publish(rpm, TEST_RPM_BASE + 10 * n);
+    delay(TEST_INTERVAL);
+  }
+  for (;;) {
+    flushLog();
+    delay(10);
+  }
+}
+
+// the samples held are the published ones, oldest first, in time order
+static void checkHistory(AutoCCServer& server, const structure_option& item, int base, int step) {
+  structure_sample samples[TELEMETRY_HISTORY];
+  const int count = server.telemetry.history(item.uniqueId, samples, TELEMETRY_HISTORY);
+  check(count == TEST_SAMPLES);
+  for (int n = 0; n < count; n++) {
+    check(samples[n].value == base + step * n);
+    check(n == 0 || samples[n].time >= samples[n - 1].time);
+  }
+}
+
+int main() {
+  radioSetup({2, 0, 0.0, 0.0});
+  structure_peer peers[1];
+  snprintf(peers[0].label, sizeof(peers[0].label), "Client 1");
+  radioMac(1, peers[0].macAddress);
+  radioSpawn(1, runPublishingClient, nullptr);
+  radioWaitForListening(1, 5000);
+  radioStart(RADIO_SERVER_NODE);
+
+  AutoCCServer server;
+  server.begin(peers, 1);
+  check(server.numOfMenuItems == 3);
+  if (server.numOfMenuItems != 3) {
+    radioStopAll();
+    return testResult();
+  }
+  const structure_option temp = server.menuItems[0];
+  const structure_option rpm = server.menuItems[1];
+  check(temp.type == TYPE_TELEMETRY && rpm.type == TYPE_TELEMETRY);
+
+  check(server.setValue(server.menuItems[TEST_TRIGGER].uniqueId, 1));
+  const unsigned long version = server.menuVersion();
+
+  const unsigned long startTime = millis();
+  while (elapsedMs(startTime) < 5000) {
+    if (server.telemetry.numOfSamples(temp.uniqueId) == TEST_SAMPLES && server.telemetry.numOfSamples(rpm.uniqueId) == TEST_SAMPLES) break;
+    server.poll();
+    delay(1);
+  }
+
+  checkHistory(server, temp, TEST_TEMP_BASE, 1);
+  checkHistory(server, rpm, TEST_RPM_BASE, 10);
+
+  // the latest sample is the item's value, without counting as a menu change
+  check(server.menuItems[0].value == TEST_TEMP_BASE + TEST_SAMPLES - 1);
+  check(server.menuItems[1].value == TEST_RPM_BASE + 10 * (TEST_SAMPLES - 1));
+  check(server.menuVersion() == version);
+
+  radioStopAll();
+  return testResult();
+}
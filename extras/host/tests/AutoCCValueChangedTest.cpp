@@ -0,0 +1,89 @@
+/*
+  AutoCCValueChangedTest.cpp
+
+  Andy Valentine - Valentine Autos
+
+  Values changed on a client reach the server over a lossy radio, as
+  each change is sent again until the server acknowledges it
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include "AutoCCClient.h"
+#include "AutoCCLog.h"
+#include "AutoCCServer.h"
+#include "HostFleet.h"
+#include "HostTest.h"
+
+#define TEST_OPTIONS          20    // changed on the client
+#define TEST_TRIGGER          TEST_OPTIONS  // option the server sets once the radio is lossy
+#define TEST_CHANGED_VALUE    500   // option j is changed to this + j
+
+// changes every option once the server sets the trigger
+static void runChangingClient(int node, void*) {
+  structure_peer server[1];
+  fleetServerPeer(server[0]);
+
+  structure_option_setup options[TEST_OPTIONS + 1];
+  for (int j = 0; j <= TEST_OPTIONS; j++) {
+    snprintf(options[j].id, sizeof(options[j].id), "opt%d", j);
+    snprintf(options[j].label, sizeof(options[j].label), "Client %d option %d", node, j);
+    options[j].type = TYPE_RANGE;
+    options[j].rangeMin = 0;
+    options[j].rangeMax = 1000;
+    options[j].value = j;
+  }
+
+  AutoCCClient* client = new AutoCCClient();
+  client->begin(server, options, TEST_OPTIONS + 1);
+  while (client->options[TEST_TRIGGER].value != 1) {
+    delay(1);
+  }
+
+  for (int j = 0; j < TEST_OPTIONS; j++) {
+    client->setValue(client->getHandle(options[j].id), TEST_CHANGED_VALUE + j);
+  }
+  for (;;) {
+    flushLog();
+    delay(10);
+  }
+}
+
+static int numOfChanged(AutoCCServer& server) {
+  int changed = 0;
+  for (int slot = 0; slot < TEST_OPTIONS; slot++) {
+    if (server.menuItems[slot].value == TEST_CHANGED_VALUE + slot) changed++;
+  }
+  return changed;
+}
+
+int main() {
+  radioSetup({2, 1, 0.0, 0.0});
+  structure_peer peers[1];
+  snprintf(peers[0].label, sizeof(peers[0].label), "Client 1");
+  radioMac(1, peers[0].macAddress);
+  radioSpawn(1, runChangingClient, nullptr);
+  check(radioWaitForListening(1, 5000));
+  radioStart(RADIO_SERVER_NODE);
+
+  AutoCCServer server;
+  server.begin(peers, 1);
+  check(server.numOfMenuItems == TEST_OPTIONS + 1);
+
+  radioConfigure({2, 1, 0.3, 0.0});
+  radioResetCounts();
+  const unsigned long triggerId = server.menuItems[TEST_TRIGGER].uniqueId;
+  while (!server.setValue(triggerId, 1)) {}
+
+  const unsigned long startTime = millis();
+  while (numOfChanged(server) < TEST_OPTIONS && millis() - startTime < 3000) {
+    server.poll();
+    delay(1);
+  }
+  check(numOfChanged(server) == TEST_OPTIONS);
+  check(radioCounts().numOfLost > 0);
+
+  radioStopAll();
+  return testResult();
+}
@@ -0,0 +1,78 @@
+/*
+  AutoCCWriteBehindTest.cpp
+
+  Andy Valentine - Valentine Autos
+
+  A client writes its values behind, so a burst of changes, e.g. a slider
+  being dragged, costs one commit once it settles for STORE_COMMIT_DELAY,
+  and changes that never settle are still committed STORE_MAX_DELAY after
+  the first. The client runs in the test's own process, without a server
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#include <nvs.h>
+#include "AutoCCClient.h"
+#include "HostFleet.h"
+#include "HostTest.h"
+
+#define TEST_DRAG_STEPS       50
+#define TEST_DRAG_INTERVAL    5     // ms between the steps of a drag
+#define TEST_SLOW_INTERVAL    100   // ms between changes that never settle, under STORE_COMMIT_DELAY
+#define TEST_MARGIN           150   // ms a commit can come after it's due, for the dispatcher to wake
+
+static int32_t savedValue(const char* key) {
+  nvs_handle_t handle;
+  int32_t value = -1;
+  nvs_open("storage", NVS_READWRITE, &handle);
+  nvs_get_i32(handle, key, &value);
+  return value;
+}
+
+int main() {
+  radioSetup({2, 0, 0.0, 0.0});
+  radioStart(1);
+
+  structure_peer server[1];
+  fleetServerPeer(server[0]);
+  structure_option_setup options[1] = {{"slider", "Slider", TYPE_RANGE, 0, 1000, 0}};
+
+  AutoCCClient client;
+  client.begin(server, options, 1);
+  const structure_option_handle slider = client.getHandle("slider");
+
+  // a drag commits once, after it settles
+  unsigned long numOfCommits = hostNumOfCommits();
+  for (int step = 1; step <= TEST_DRAG_STEPS; step++) {
+    client.setValue(slider, step);
+    delay(TEST_DRAG_INTERVAL);
+  }
+  check(hostNumOfCommits() == numOfCommits);
+  delay(STORE_COMMIT_DELAY + TEST_MARGIN);
+  check(hostNumOfCommits() == numOfCommits + 1);
+  check(savedValue("slider") == TEST_DRAG_STEPS);
+
+  // changes that never settle are committed STORE_MAX_DELAY after the first
+  numOfCommits = hostNumOfCommits();
+  const unsigned long startTime = millis();
+  unsigned long committedMs = 0;
+  for (int value = 1; elapsedMs(startTime) < STORE_MAX_DELAY + TEST_MARGIN; value++) {
+    client.setValue(slider, value);
+    const unsigned long changedAt = millis();
+    while (elapsedMs(changedAt) < TEST_SLOW_INTERVAL) {
+      if (committedMs == 0 && hostNumOfCommits() > numOfCommits) {
+        committedMs = elapsedMs(startTime);
+      }
+      delay(5);
+    }
+  }
+  printf("forced_commit_ms %lu\n", committedMs);
+
+  check(hostNumOfCommits() == numOfCommits + 1);
+  check(committedMs >= STORE_MAX_DELAY);
+  check(committedMs < STORE_MAX_DELAY + TEST_MARGIN);
+
+  radioStopAll();
+  return testResult();
+}
@@ -0,0 +1,33 @@
+/*
+  HostTest.h
+
+  Andy Valentine - Valentine Autos
+
+  Checks for the host tests - each prints what failed and counts it, and
+  a test's main returns testResult() so ctest sees the failures
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files.
+*/
+
+#ifndef HostTest_h
+#define HostTest_h
+
+#include <cstdio>
+
+static int numOfFailedChecks = 0;
+
+#define check(condition) \
+  do { \
+    if (!(condition)) { \
+      printf("%s:%d check failed: %s\n", __FILE__, __LINE__, #condition); \
+      numOfFailedChecks++; \
+    } \
+  } while (0)
+
+static int testResult() {
+  printf("%s\n", numOfFailedChecks ? "FAILED" : "OK");
+  return numOfFailedChecks ? 1 : 0;
+}
+
+#endif